@@ -0,0 +1,362 @@
+/******************************************************************************
+  This source file is part of the Avogadro project.
+  This source code is released under the 3-Clause BSD License, (see "LICENSE").
+******************************************************************************/
+
+#include "autosaver.h"
+
+#include <avogadro/core/array.h>
+#include <avogadro/io/cjsonformat.h>
+#include <avogadro/qtgui/molecule.h>
+
+#include <QtConcurrent/QtConcurrentRun>
+#include <QtCore/QCoreApplication>
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QDebug>
+#include <QtCore/QDir>
+#include <QtCore/QFutureWatcher>
+#include <QtCore/QJsonArray>
+#include <QtCore/QJsonDocument>
+#include <QtCore/QJsonObject>
+#include <QtCore/QLockFile>
+#include <QtCore/QSaveFile>
+#include <QtCore/QScopedPointer>
+#include <QtCore/QSettings>
+#include <QtCore/QStandardPaths>
+#include <QtCore/QTimer>
+
+#include <string>
+
+namespace Avogadro {
+
+namespace {
+// How long the user has to pause editing before a copy is written.
+const int idleDelay = 5000;
+
+template<typename T>
+void addArray(QCryptographicHash& hash, const Core::Array<T>& array)
+{
+  if (!array.empty()) {
+    hash.addData(QByteArray::fromRawData(
+      reinterpret_cast<const char*>(array.data()),
+      static_cast<int>(array.size() * sizeof(T))));
+  }
+}
+
+// Hash what an edit can change, much cheaper than writing the file.
+QByteArray contentHash(const Core::Molecule& molecule)
+{
+  QCryptographicHash hash(QCryptographicHash::Sha1);
+  addArray(hash, molecule.atomicNumbers());
+  addArray(hash, molecule.atomPositions3d());
+  addArray(hash, molecule.bondPairs());
+  addArray(hash, molecule.bondOrders());
+  hash.addData(QByteArray::number(molecule.coordinate3dCount()));
+  hash.addData(QByteArray::fromStdString(molecule.data("name").toString()));
+  return hash.result();
+}
+
+// Run on the I/O workers, takes ownership of the snapshot.
+QByteArray writeCopy(Core::Molecule* snapshot, const QString& fileName,
+                     const QByteArray& previous)
+{
+  QScopedPointer<Core::Molecule> molecule(snapshot);
+  QByteArray hash = contentHash(*molecule);
+  if (hash == previous)
+    return hash;
+
+  std::string data;
+  Io::CjsonFormat format;
+  QSaveFile file(fileName);
+  if (!format.writeString(data, *molecule) ||
+      !file.open(QIODevice::WriteOnly) ||
+      file.write(data.data(), static_cast<qint64>(data.size())) !=
+        static_cast<qint64>(data.size()) ||
+      !file.commit()) {
+    qWarning() << "Autosave to" << fileName << "failed" << file.errorString();
+    return QByteArray();
+  }
+  return hash;
+}
+} // namespace
+
+AutoSaver::AutoSaver(QThreadPool* pool, QObject* parent)
+  : QObject(parent)
+  , m_pool(pool)
+  , m_timer(new QTimer(this))
+  , m_lock(nullptr)
+  , m_removeWritten(false)
+  , m_interval(60)
+  , m_nextFile(1)
+  , m_enabled(true)
+  , m_writing(false)
+{
+  m_timer->setSingleShot(true);
+  connect(m_timer, &QTimer::timeout, this, &AutoSaver::saveNext);
+
+  QSettings settings;
+  settings.beginGroup("autosave");
+  m_enabled = settings.value("enabled", true).toBool();
+  m_interval = qMax(10, settings.value("interval", 60).toInt());
+  settings.endGroup();
+}
+
+AutoSaver::~AutoSaver()
+{
+  // A write still running finishes in the pool, the directory goes anyway.
+  if (m_lock) {
+    QDir(m_sessionPath).removeRecursively();
+    delete m_lock;
+  }
+  foreach (const QString& path, m_stalePaths)
+    QDir(path).removeRecursively();
+  qDeleteAll(m_staleLocks);
+}
+
+void AutoSaver::setEnabled(bool enabled)
+{
+  m_enabled = enabled;
+  QSettings().setValue("autosave/enabled", enabled);
+  if (!enabled)
+    m_timer->stop();
+}
+
+void AutoSaver::setInterval(int seconds)
+{
+  m_interval = qMax(10, seconds);
+  QSettings().setValue("autosave/interval", m_interval);
+}
+
+int AutoSaver::interval(size_t atomCount) const
+{
+  // Writing grows with the size, so does the time between copies: twice the
+  // interval per 25,000 atoms, up to ten times.
+  size_t factor = qMin<size_t>(10, 1 + atomCount / 25000);
+  return m_interval * static_cast<int>(factor);
+}
+
+void AutoSaver::moleculeChanged(QtGui::Molecule* molecule)
+{
+  if (!m_enabled || !molecule)
+    return;
+
+  if (!m_entries.contains(molecule)) {
+    Entry entry;
+    entry.fileName = QString("%1.cjson").arg(m_nextFile++);
+    entry.pending = false;
+    m_entries.insert(molecule, entry);
+    connect(molecule, &QObject::destroyed, this,
+            [this, molecule]() { remove(molecule); });
+  }
+  if (!m_entries[molecule].pending) {
+    m_entries[molecule].pending = true;
+    m_dirty.append(molecule);
+  }
+
+  // Wait for a pause in the edits.
+  m_timer->start(idleDelay);
+}
+
+void AutoSaver::discard(QtGui::Molecule* molecule)
+{
+  if (!m_entries.contains(molecule))
+    return;
+
+  disconnect(molecule, nullptr, this, nullptr);
+  remove(molecule);
+}
+
+void AutoSaver::remove(QtGui::Molecule* molecule)
+{
+  Entry entry = m_entries.take(molecule);
+  m_dirty.removeAll(molecule);
+  QString fileName = m_sessionPath + '/' + entry.fileName;
+  // The write would create the file again, remove it once it is done.
+  if (m_writing && fileName == m_writingFile)
+    m_removeWritten = true;
+  if (!entry.saved.isValid())
+    return;
+
+  QFile::remove(fileName);
+  writeJournal();
+}
+
+void AutoSaver::saveNext()
+{
+  if (m_writing || !m_enabled)
+    return;
+
+  QDateTime now = QDateTime::currentDateTime();
+  qint64 wait = -1;
+  for (int i = 0; i < m_dirty.size(); ++i) {
+    QtGui::Molecule* molecule = m_dirty.at(i);
+    if (!molecule || !m_entries.contains(molecule))
+      continue;
+
+    // Large molecules are written less often.
+    Entry& entry = m_entries[molecule];
+    if (entry.saved.isValid()) {
+      QDateTime due =
+        entry.saved.addSecs(interval(molecule->atomCount()));
+      if (now < due) {
+        qint64 left = now.msecsTo(due);
+        wait = wait < 0 ? left : qMin(wait, left);
+        continue;
+      }
+    }
+
+    if (!openSession())
+      return;
+    m_dirty.removeAt(i);
+    entry.pending = false;
+    entry.originalFileName =
+      QString::fromStdString(molecule->data("fileName").toString());
+
+    // Taken here, as the molecule may be edited while the copy is written.
+    // Only the atom data arrays are shared, the rest is copied.
+    auto* snapshot = new Core::Molecule(*molecule);
+    QString fileName = m_sessionPath + '/' + entry.fileName;
+    QPointer<QtGui::Molecule> target(molecule);
+    m_writing = true;
+    m_writingFile = fileName;
+
+    auto* watcher = new QFutureWatcher<QByteArray>(this);
+    connect(watcher, &QFutureWatcher<QByteArray>::finished, this,
+            [this, watcher, target]() {
+              writeFinished(target, watcher->result());
+              watcher->deleteLater();
+            });
+    watcher->setFuture(
+      QtConcurrent::run(m_pool, writeCopy, snapshot, fileName, entry.hash));
+    return;
+  }
+
+  m_dirty.removeAll(nullptr);
+  if (wait >= 0)
+    m_timer->start(static_cast<int>(qMax<qint64>(wait, idleDelay)));
+}
+
+void AutoSaver::writeFinished(QtGui::Molecule* molecule, const QByteArray& hash)
+{
+  m_writing = false;
+  if (m_removeWritten) {
+    m_removeWritten = false;
+    QFile::remove(m_writingFile);
+  } else if (molecule && m_entries.contains(molecule) && !hash.isEmpty()) {
+    Entry& entry = m_entries[molecule];
+    bool changed = entry.hash != hash;
+    entry.hash = hash;
+    entry.saved = QDateTime::currentDateTime();
+    if (changed)
+      writeJournal();
+  }
+
+  if (!m_dirty.isEmpty() && !m_timer->isActive())
+    m_timer->start(idleDelay);
+}
+
+bool AutoSaver::openSession()
+{
+  if (m_lock)
+    return true;
+
+  QString path = QString("%1/%2-%3")
+                   .arg(recoveryPath())
+                   .arg(QCoreApplication::applicationPid())
+                   .arg(QDateTime::currentMSecsSinceEpoch());
+  if (!QDir().mkpath(path)) {
+    qWarning() << "Cannot create the autosave directory" << path;
+    m_enabled = false;
+    return false;
+  }
+
+  m_lock = new QLockFile(path + "/lock");
+  if (!m_lock->tryLock(0)) {
+    delete m_lock;
+    m_lock = nullptr;
+    m_enabled = false;
+    return false;
+  }
+  m_sessionPath = path;
+  return true;
+}
+
+void AutoSaver::writeJournal()
+{
+  if (!m_lock)
+    return;
+
+  QJsonArray entries;
+  for (auto it = m_entries.constBegin(); it != m_entries.constEnd(); ++it) {
+    if (!it->saved.isValid())
+      continue;
+    QJsonObject entry;
+    entry["file"] = it->fileName;
+    entry["original"] = it->originalFileName;
+    entry["saved"] = it->saved.toString(Qt::ISODate);
+    entries.append(entry);
+  }
+
+  QSaveFile file(m_sessionPath + "/journal.json");
+  if (file.open(QIODevice::WriteOnly)) {
+    QJsonObject journal;
+    journal["entries"] = entries;
+    file.write(QJsonDocument(journal).toJson());
+    file.commit();
+  }
+}
+
+QList<AutoSaver::Recovered> AutoSaver::recoverable()
+{
+  QList<Recovered> result;
+  QDir recovery(recoveryPath());
+  foreach (const QString& name,
+           recovery.entryList(QDir::Dirs | QDir::NoDotAndDotDot)) {
+    QString path = recovery.filePath(name);
+    if (path == m_sessionPath || m_stalePaths.contains(path))
+      continue;
+
+    // Held by a running instance, a lock left by a crash is removed.
+    auto* lock = new QLockFile(path + "/lock");
+    if (!lock->tryLock(0)) {
+      delete lock;
+      continue;
+    }
+    m_staleLocks.append(lock);
+    m_stalePaths.append(path);
+
+    QFile file(path + "/journal.json");
+    if (!file.open(QIODevice::ReadOnly))
+      continue;
+    QJsonObject journal = QJsonDocument::fromJson(file.readAll()).object();
+    foreach (const QJsonValue& value, journal["entries"].toArray()) {
+      QJsonObject entry = value.toObject();
+      Recovered copy;
+      copy.fileName = path + '/' + entry["file"].toString();
+      copy.originalFileName = entry["original"].toString();
+      copy.saved =
+        QDateTime::fromString(entry["saved"].toString(), Qt::ISODate);
+      if (QFile::exists(copy.fileName))
+        result.append(copy);
+    }
+  }
+  return result;
+}
+
+void AutoSaver::discardRecovered()
+{
+  foreach (const QString& path, m_stalePaths)
+    QDir(path).removeRecursively();
+  qDeleteAll(m_staleLocks);
+  m_staleLocks.clear();
+  m_stalePaths.clear();
+}
+
+QString AutoSaver::recoveryPath()
+{
+  return QStandardPaths::writableLocation(
+           QStandardPaths::AppLocalDataLocation) +
+         "/recovery";
+}
+
+} // End namespace Avogadro
@@ -0,0 +1,150 @@
+/******************************************************************************
+  This source file is part of the Avogadro project.
+  This source code is released under the 3-Clause BSD License, (see "LICENSE").
+******************************************************************************/
+
+#ifndef AVOGADRO_AUTOSAVER_H
+#define AVOGADRO_AUTOSAVER_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QDateTime>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QObject>
+#include <QtCore/QPointer>
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+
+class QLockFile;
+class QThreadPool;
+class QTimer;
+
+namespace Avogadro {
+
+namespace Core {
+class Molecule;
+}
+
+namespace QtGui {
+class Molecule;
+}
+
+/**
+ * @brief The AutoSaver class keeps recovery copies of unsaved molecules.
+ *
+ * Edited molecules are written as CJSON to a directory of the session once
+ * the user has paused for a few seconds, at most once per interval. The
+ * interval grows with the number of atoms so that large systems are written
+ * less often. The work is done from a snapshot of the molecule on the I/O
+ * workers, and skipped when the content has not changed since the previous
+ * copy.
+ *
+ * Each session directory holds a journal of its copies and a lock file. A
+ * directory whose lock is not held by a running process was left by a crash,
+ * its copies can be restored with recoverable().
+ */
+class AutoSaver : public QObject
+{
+  Q_OBJECT
+
+public:
+  /** A copy left by a previous session. */
+  struct Recovered
+  {
+    /** The recovery copy, a CJSON file. */
+    QString fileName;
+    /** The file the molecule was read from, or empty if it was new. */
+    QString originalFileName;
+    QDateTime saved;
+  };
+
+  /**
+   * Run the writes on @a pool, usually FileJobQueue::threadPool().
+   */
+  explicit AutoSaver(QThreadPool* pool, QObject* parent = nullptr);
+  /** Removes the copies of this session, the application closed normally. */
+  ~AutoSaver() override;
+
+  /**
+   * Whether autosaving is done, and the interval in seconds for small
+   * molecules. Stored in the "autosave" settings group.
+   * @{
+   */
+  void setEnabled(bool enabled);
+  bool isEnabled() const { return m_enabled; }
+  void setInterval(int seconds);
+  int interval() const { return m_interval; }
+  /**@}*/
+
+  /**
+   * @return The interval in seconds for a molecule of @a atomCount atoms.
+   */
+  int interval(size_t atomCount) const;
+
+  /**
+   * @a molecule has unsaved changes, write a copy once the user is idle.
+   */
+  void moleculeChanged(QtGui::Molecule* molecule);
+
+  /**
+   * @a molecule was saved, or its changes discarded. Its copy is removed.
+   */
+  void discard(QtGui::Molecule* molecule);
+
+  /**
+   * @return The copies left by sessions that did not close normally. Their
+   * directories are locked by this session and removed once it closes
+   * normally, so a crash while they are restored loses nothing.
+   */
+  QList<Recovered> recoverable();
+
+  /**
+   * Remove the copies returned by recoverable().
+   */
+  void discardRecovered();
+
+  /**
+   * @return The directory holding the session directories.
+   */
+  static QString recoveryPath();
+
+private slots:
+  void saveNext();
+
+private:
+  struct Entry
+  {
+    QString fileName;
+    QString originalFileName;
+    QByteArray hash;
+    QDateTime saved;
+    bool pending;
+  };
+
+  QThreadPool* m_pool;
+  QTimer* m_timer;
+  QString m_sessionPath;
+  QLockFile* m_lock;
+  QHash<QtGui::Molecule*, Entry> m_entries;
+  QList<QPointer<QtGui::Molecule>> m_dirty;
+  QList<QLockFile*> m_staleLocks;
+  QStringList m_stalePaths;
+  // the copy being written, and whether its molecule was removed meanwhile
+  QString m_writingFile;
+  bool m_removeWritten;
+  int m_interval;
+  int m_nextFile;
+  bool m_enabled;
+  bool m_writing;
+
+  /** Create the session directory and take its lock, once needed. */
+  bool openSession();
+  /** Write the journal listing the copies of this session. */
+  void writeJournal();
+  void remove(QtGui::Molecule* molecule);
+  void writeFinished(QtGui::Molecule* molecule, const QByteArray& hash);
+};
+
+} // End namespace Avogadro
+
+#endif // AVOGADRO_AUTOSAVER_H
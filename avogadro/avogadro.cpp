@@ -11,9 +11,10 @@
 
 #include <QtCore/QDebug>
 #include <QtCore/QDir>
+#include <QtCore/QFileInfo>
 #include <QtCore/QLibraryInfo>
 #include <QtCore/QLocale>
-#include <QtCore/QProcess>
+#include <QtCore/QScopedPointer>
 #include <QtCore/QSettings>
 #include <QtCore/QStandardPaths>
 #include <QtCore/QTranslator>
@@ -24,6 +25,8 @@
 
 #include "application.h"
 #include "mainwindow.h"
+#include "shadercache.h"
+#include "startupprofiler.h"
 
 #ifdef Q_OS_MAC
 void removeMacSpecificMenuItems();
@@ -31,6 +34,13 @@ void removeMacSpecificMenuItems();
 
 #ifdef Avogadro_ENABLE_RPC
 #include "rpclistener.h"
+
+#include <QtCore/QDataStream>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QJsonDocument>
+#include <QtCore/QJsonObject>
+#include <QtCore/QMap>
+#include <QtNetwork/QLocalSocket>
 #endif
 
 #define DEBUG false
@@ -94,8 +104,95 @@ void myMessageOutput(QtMsgType type, const QMessageLogContext& context,
   ts << message << Qt::endl;
 }
 
+#ifdef Avogadro_ENABLE_RPC
+// Pass the files on the command line to an instance that is already running,
+// through the socket served by its RpcListener. Returns true if that instance
+// accepted all of them, so this process can exit before building a window.
+// Otherwise @a accepted holds the absolute paths of those it did take.
+//
+// This runs before any application object exists, so the socket is used with
+// its blocking calls and the messages are framed as MoleQueue does: a JSON-RPC
+// document in a QDataStream byte array.
+bool forwardToRunningInstance(int argc, char* argv[], QStringList& accepted)
+{
+  QStringList fileNames;
+  for (int i = 1; i < argc; ++i) {
+    if (qstrcmp(argv[i], "--new-instance") == 0)
+      return false;
+    if (qstrcmp(argv[i], "--test-file") == 0 ||
+        qstrcmp(argv[i], "--profile-startup-file") == 0) {
+      ++i;
+      continue;
+    }
+    // Values of options such as "-style fusion" are not files, and the running
+    // instance has a different working directory.
+    QFileInfo info(QString::fromLocal8Bit(argv[i]));
+    if (argv[i][0] != '-' && info.isFile())
+      fileNames << info.absoluteFilePath();
+  }
+  if (fileNames.isEmpty())
+    return false;
+
+  // A live instance answers straight away, the files are read afterwards.
+  const int timeout = 1000;
+  QElapsedTimer timer;
+  timer.start();
+  QLocalSocket socket;
+  socket.connectToServer("avogadro");
+  if (!socket.waitForConnected(timeout))
+    return false;
+
+  QDataStream stream(&socket);
+  stream.setVersion(QDataStream::Qt_4_8);
+  QMap<int, QString> pending;
+  int id = 0;
+  foreach (const QString& fileName, fileNames) {
+    QJsonObject params;
+    params["fileName"] = fileName;
+    QJsonObject request;
+    request["jsonrpc"] = QLatin1String("2.0");
+    request["id"] = ++id;
+    request["method"] = QLatin1String("queueFile");
+    request["params"] = params;
+    stream << QJsonDocument(request).toJson(QJsonDocument::Compact);
+    pending.insert(id, fileName);
+  }
+  while (socket.bytesToWrite() > 0 && timer.elapsed() < timeout)
+    socket.waitForBytesWritten(timeout - timer.elapsed());
+
+  while (!pending.isEmpty() && timer.elapsed() < timeout) {
+    stream.startTransaction();
+    QByteArray packet;
+    stream >> packet;
+    if (!stream.commitTransaction()) {
+      if (!socket.waitForReadyRead(timeout - timer.elapsed()))
+        break;
+      continue;
+    }
+    QJsonObject response = QJsonDocument::fromJson(packet).object();
+    QString fileName = pending.take(response["id"].toInt());
+    if (!fileName.isEmpty() && response["result"].toBool())
+      accepted << fileName;
+  }
+  socket.disconnectFromServer();
+  return accepted.size() == fileNames.size();
+}
+#endif
+
 int main(int argc, char* argv[])
 {
+  // Enable profiling before anything else, so all phases are recorded.
+  Avogadro::StartupProfiler& profiler = Avogadro::StartupProfiler::instance();
+  bool clearShaderCache = false;
+  for (int i = 1; i < argc; ++i) {
+    if (qstrcmp(argv[i], "--profile-startup") == 0)
+      profiler.setEnabled(true);
+    else if (qstrcmp(argv[i], "--clear-shader-cache") == 0)
+      clearShaderCache = true;
+    else if (qstrcmp(argv[i], "--disable-settings") == 0)
+      Avogadro::ShaderCache::instance().setSettingsEnabled(false);
+  }
+
 #ifdef Q_OS_MAC
   // call some Objective-C++
   removeMacSpecificMenuItems();
@@ -119,10 +216,39 @@ int main(int argc, char* argv[])
   qInstallMessageHandler(myMessageOutput);
 #endif
 
+  // All GL contexts share with one global context, so the driver state and
+  // the shader programs compiled for the first view are reused by later ones.
+  // The global context is created along with the application, so the default
+  // format must be set before that. Qt only honours the attribute before the
+  // application object is created.
+  QCoreApplication::setAttribute(Qt::AA_ShareOpenGLContexts);
+  QSurfaceFormat defaultFormat = QSurfaceFormat::defaultFormat();
+  defaultFormat.setSamples(4);
+#if defined(Q_OS_MAC) || defined(Q_OS_WIN)
+  defaultFormat.setAlphaBufferSize(8);
+#endif
+  QSurfaceFormat::setDefaultFormat(defaultFormat);
+
+  // Files taken by a running instance, not to be opened here as well.
+  QStringList forwardedFiles;
+#ifdef Avogadro_ENABLE_RPC
+  // Hand the files over to a running instance before any plugins, GL context
+  // or window are created.
+  if (forwardToRunningInstance(argc, argv, forwardedFiles))
+    return EXIT_SUCCESS;
+#endif
+
+  // The driver shader caches are read when the first context is created.
+  Avogadro::ShaderCache::instance().configure(clearShaderCache);
+
+  profiler.begin("application");
   Avogadro::Application app(argc, argv);
+  profiler.end("application");
 
+  profiler.begin("settings");
   QSettings settings;
   QString language = settings.value("locale", "System").toString();
+  profiler.end("settings");
 
   // Before we do much else, load translations
   // This ensures help messages and debugging info can be translated
@@ -132,14 +258,13 @@ int main(int argc, char* argv[])
   }
   qDebug() << "Using locale: " << currentLocale.name();
 
+  profiler.begin("translations");
   QStringList translationPaths;
   // check environment variable and local paths
-  foreach (const QString& variable, QProcess::systemEnvironment()) {
-    QStringList split1 = variable.split('=');
-    if (split1[0] == "AVOGADRO_TRANSLATIONS") {
-      foreach (const QString& path, split1[1].split(':'))
-        translationPaths << path;
-    }
+  QString envPaths = qEnvironmentVariable("AVOGADRO_TRANSLATIONS");
+  foreach (const QString& path, envPaths.split(QDir::listSeparator())) {
+    if (!path.isEmpty())
+      translationPaths << path;
   }
 
   translationPaths << QLibraryInfo::location(QLibraryInfo::TranslationsPath);
@@ -167,6 +292,10 @@ int main(int argc, char* argv[])
   QString successfulPath;
 
   foreach (const QString& translationPath, translationPaths) {
+    if (qtLoaded && avoLoaded && libsLoaded)
+      break;
+    if (!QDir(translationPath).exists())
+      continue;
     if (!qtLoaded &&
         qtTranslator->load(currentLocale, "qt", "_", translationPath)) {
       if (app.installTranslator(qtTranslator)) {
@@ -200,8 +329,8 @@ int main(int argc, char* argv[])
     }
   } // done looking for translations
 
-  // Go through the possible translations / locale codes
-  // to get the localized names for the language dialog
+  // The list of available languages is only needed by the language dialog,
+  // the main window builds it on demand from this directory.
   if (successfulPath.isEmpty()) {
     // the default for most systems
     // (e.g., /usr/bin/avogadro2 -> /usr/share/avogadro2/i18n/)
@@ -210,54 +339,28 @@ int main(int argc, char* argv[])
     successfulPath =
       QCoreApplication::applicationDirPath() + "/../share/avogadro2/i18n/";
   }
-
-  QDir dir(successfulPath);
-  QStringList files =
-    dir.entryList(QStringList() << "avogadroapp*.qm", QDir::Files);
-  QStringList languages, codes;
-
-  languages << "System"; // we handle this in the dialog
-  codes << "";           // default is the system language
-
-  bool addedUS = false;
-
-  // check what files exist
-  foreach (const QString& file, files) {
-    // remove "avogadroapp-" and the ".qm"
-    QString localeCode = file.left(file.indexOf('.')).remove("avogadroapp-");
-
-    if (localeCode.startsWith("en") && !addedUS) {
-      // add US English (default)
-      addedUS = true;
-      QLocale us("en_US");
-      languages << us.nativeLanguageName();
-      codes << "en_US";
-    }
-
-    QLocale locale(localeCode);
-    QString languageName = locale.nativeLanguageName();
-    if (languageName.isEmpty() && localeCode == "oc")
-      languageName = "Occitan";
-    // potentially other exceptions here
-
-    // cases like Brazilian Portuguese show up as duplicates
-    if (languages.contains(languageName)) {
-      languageName += " (" + locale.nativeCountryName() + ")";
-    }
-
-    languages << languageName;
-    codes << localeCode;
+  profiler.end("translations");
+
+  // Check for valid OpenGL support with the shared context, rather than a
+  // throwaway one, so the driver is initialized once and stays warm for the
+  // first view. The surface is kept for the lifetime of the application.
+  profiler.begin("OpenGL probe");
+  QOffscreenSurface offscreen;
+  offscreen.create();
+  QScopedPointer<QOpenGLContext> probeContext;
+  QOpenGLContext* context = QOpenGLContext::globalShareContext();
+  if (!context) {
+    // Not every platform plugin creates the shared context.
+    probeContext.reset(new QOpenGLContext);
+    probeContext->create();
+    context = probeContext.data();
   }
-
-  // Check for valid OpenGL support.
-  auto offscreen = new QOffscreenSurface;
-  offscreen->create();
-  auto context = new QOpenGLContext;
-  context->create();
-  context->makeCurrent(offscreen);
-  bool contextIsValid = context->isValid();
-  delete context;
-  delete offscreen;
+  bool contextIsValid = context->isValid() && context->makeCurrent(&offscreen);
+  if (contextIsValid) {
+    Avogadro::ShaderCache::instance().setDriver(context);
+    context->doneCurrent();
+  }
+  profiler.end("OpenGL probe");
 
   if (!contextIsValid) {
     QMessageBox::information(
@@ -267,14 +370,6 @@ int main(int argc, char* argv[])
     return 1;
   }
 
-  // Set up the default format for our GL contexts.
-  QSurfaceFormat defaultFormat = QSurfaceFormat::defaultFormat();
-  defaultFormat.setSamples(4);
-#if defined(Q_OS_MAC) || defined(Q_OS_WIN)
-  defaultFormat.setAlphaBufferSize(8);
-#endif
-  QSurfaceFormat::setDefaultFormat(defaultFormat);
-
   QStringList fileNames;
   bool disableSettings = false;
 #ifdef QTTESTING
@@ -300,20 +395,30 @@ int main(int argc, char* argv[])
 #endif
     } else if (*it == "--disable-settings") {
       disableSettings = true;
+    } else if (*it == "--profile-startup" || *it == "--clear-shader-cache" ||
+               *it == "--new-instance") {
+      // Handled before the application was created.
+    } else if (*it == "--profile-startup-file" && it + 1 != args.constEnd()) {
+      profiler.setOutputFile(*(++it));
     } else if (it->startsWith("-")) {
       qWarning("Unknown command line option '%s'", qPrintable(*it));
       return EXIT_FAILURE;
-    } else { // Assume it is a file name.
+    } else if (!forwardedFiles.contains(QFileInfo(*it).absoluteFilePath())) {
+      // Assume it is a file name.
       fileNames << *it;
     }
   }
 
+  profiler.begin("main window");
   Avogadro::MainWindow window(fileNames, disableSettings);
-  window.setTranslationList(languages, codes);
+  window.setTranslationPath(successfulPath);
 #ifdef QTTESTING
   window.playTest(testFile, testExit);
 #endif
+  profiler.end("main window");
+  profiler.begin("show");
   window.show();
+  profiler.end("show");
 
 #ifdef Avogadro_ENABLE_RPC
   // create rpc listener
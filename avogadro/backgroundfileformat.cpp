@@ -4,14 +4,111 @@
 ******************************************************************************/
 
 #include "backgroundfileformat.h"
+#include "compressedstreambuf.h"
+#include "iodevicestreambuf.h"
+#include "memorystreambuf.h"
+#include "moleculecache.h"
+#include "recordindex.h"
 
+#include <avogadro/core/molecule.h>
 #include <avogadro/io/fileformat.h>
 
+#include <QtCore/QBuffer>
+#include <QtCore/QDebug>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QList>
+#include <QtCore/QLocale>
+#include <QtCore/QLoggingCategory>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QSaveFile>
+#include <QtCore/QScopedPointer>
+
+#include <cstdlib>
+#include <istream>
+#include <limits>
+#include <ostream>
+#include <sstream>
+
+#ifdef Q_OS_UNIX
+#include <sys/mman.h>
+#endif
+
 namespace Avogadro {
 
+namespace {
+// The timings of stream reads, enabled with
+// QT_LOGGING_RULES="avogadro.io.read.debug=true".
+Q_LOGGING_CATEGORY(lcRead, "avogadro.io.read", QtWarningMsg)
+
+std::atomic_bool useMemoryMapping(false);
+std::atomic_bool useDeferredCubes(true);
+
+// Reads taking longer are added to the MoleculeCache.
+const qint64 slowRead = 500;
+
+bool isCubeFile(const QString& fileName)
+{
+  QString suffix = QFileInfo(fileName).suffix().toLower();
+  return suffix == "cube" || suffix == "cub";
+}
+
+// Add the atoms listed in the header of a Gaussian cube file, if all of it
+// could be parsed. The grid values are left to the file format.
+bool readCubeHeader(QIODevice& device, Core::Molecule& molecule)
+{
+  const double bohrToAngstrom = 0.52917721092;
+
+  // Two comment lines, the atom count with the origin and the three axes.
+  device.readLine();
+  device.readLine();
+  QList<QByteArray> fields = device.readLine().simplified().split(' ');
+  bool ok = fields.size() >= 4;
+  int atomCount = ok ? fields[0].toInt(&ok) : 0;
+  double scale = bohrToAngstrom;
+  for (int i = 0; ok && i < 3; ++i) {
+    fields = device.readLine().simplified().split(' ');
+    int points = fields.size() >= 4 ? fields[0].toInt(&ok) : 0;
+    ok = ok && points != 0;
+    // A negative count means the lengths are in Ångström.
+    if (i == 0 && points < 0)
+      scale = 1.0;
+  }
+  if (!ok)
+    return false;
+
+  // A negative atom count means a list of orbitals follows the atoms.
+  std::vector<unsigned char> numbers;
+  std::vector<Vector3> positions;
+  for (int i = 0; i < std::abs(atomCount); ++i) {
+    fields = device.readLine().simplified().split(' ');
+    if (fields.size() < 5)
+      return false;
+    bool valid[4] = { false, false, false, false };
+    numbers.push_back(static_cast<unsigned char>(fields[0].toUInt(&valid[0])));
+    positions.push_back(Vector3(fields[2].toDouble(&valid[1]),
+                                fields[3].toDouble(&valid[2]),
+                                fields[4].toDouble(&valid[3])) *
+                        scale);
+    if (!valid[0] || !valid[1] || !valid[2] || !valid[3])
+      return false;
+  }
+
+  for (size_t i = 0; i < numbers.size(); ++i) {
+    auto atom = molecule.addAtom(numbers[i]);
+    atom.setPosition3d(positions[i]);
+  }
+  molecule.perceiveBondsSimple();
+  return true;
+}
+} // namespace
+
 BackgroundFileFormat::BackgroundFileFormat(Io::FileFormat* format,
                                            QObject* aparent)
-  : QObject(aparent), m_format(format), m_molecule(nullptr), m_success(false)
+  : QObject(aparent), m_format(format), m_molecule(nullptr), m_success(false),
+    m_canceled(false), m_bytesProcessed(0), m_bytesTotal(0), m_frameBytes(0),
+    m_frameCount(0), m_cacheFrames(false)
 {
 }
 
@@ -24,6 +121,12 @@ void BackgroundFileFormat::read()
 {
   m_success = false;
   m_error.clear();
+  m_bytesProcessed = 0;
+  m_bytesTotal = 0;
+  m_frameBytes = 0;
+  m_frameCount = 0;
+  m_cacheFrames = false;
+  m_cubes.reset();
 
   if (!m_molecule)
     m_error = tr("No molecule set in BackgroundFileFormat!");
@@ -35,20 +138,247 @@ void BackgroundFileFormat::read()
     m_error = tr("No file name set in BackgroundFileFormat!");
 
   if (m_error.isEmpty()) {
-    m_success = m_format->readFile(m_fileName.toLocal8Bit().data(),
-                                   *m_molecule);
+    QElapsedTimer elapsed;
+    elapsed.start();
+    MoleculeCache& cache = MoleculeCache::instance();
+    QString reader = QString::fromStdString(m_format->identifier());
+    QFile file(m_fileName);
+    bool streams = m_format->supportedOperations() & Io::FileFormat::Stream;
+    bool cached = cache.read(m_fileName, reader, *m_molecule);
+    if (cached) {
+      m_success = true;
+    } else if (streams && !file.open(QIODevice::ReadOnly)) {
+      m_error = tr("Could not open “%1” for reading: %2")
+                  .arg(m_fileName, file.errorString());
+    } else if (streams) {
+      QElapsedTimer timer;
+      timer.start();
+      m_bytesTotal = file.size();
+
+      // Compressed files are recognized by their content, not their name.
+      QByteArray magic = file.peek(6);
+      CompressedStreamBuf::Codec codec =
+        CompressedStreamBuf::detect(magic.constData(), magic.size());
+
+      // Opt in: parse the page cache in place rather than copying it.
+      uchar* mapped = nullptr;
+      if (useMemoryMapping && file.size() > 0)
+        mapped = file.map(0, file.size());
+#ifdef Q_OS_UNIX
+      if (mapped)
+        madvise(mapped, static_cast<size_t>(file.size()), MADV_SEQUENTIAL);
+#endif
+
+      // The atoms of cube files can be shown before their grids are read.
+      Core::Molecule* target = m_molecule;
+      if (codec == CompressedStreamBuf::None && useDeferredCubes &&
+          isCubeFile(m_fileName)) {
+        if (readCubeHeader(file, *m_molecule)) {
+          m_cubes.reset(new Core::Molecule);
+          target = m_cubes.data();
+          emit firstFrameRead();
+        }
+        file.seek(0);
+      }
 
-    if (!m_success)
+      if (codec == CompressedStreamBuf::None &&
+          RecordIndex::layoutForFile(m_fileName) == RecordIndex::Xyz) {
+        readFrames(file, mapped);
+      } else if (mapped) {
+        MemoryStreamBuf buffer(reinterpret_cast<const char*>(mapped),
+                               static_cast<size_t>(file.size()), &m_canceled,
+                               &m_bytesProcessed);
+        readStream(&buffer, codec, *target);
+      } else {
+        IODeviceStreamBuf buffer(&file, &m_canceled, &m_bytesProcessed);
+        readStream(&buffer, codec, *target);
+      }
+
+      // Allows comparing the two read paths on the same files.
+      qCDebug(lcRead).noquote()
+        << QString("Read %1 (%2) in %3 ms, %4 %5")
+             .arg(m_fileName)
+             .arg(QLocale().formattedDataSize(file.size()))
+             .arg(timer.elapsed())
+             .arg(mapped ? "mapped" : "buffered")
+             .arg(CompressedStreamBuf::codecName(codec));
+      if (mapped)
+        file.unmap(mapped);
+    } else if (CompressedStreamBuf::codecForFileName(m_fileName) !=
+               CompressedStreamBuf::None) {
+      m_error = tr("The file format cannot read compressed files.");
+    } else {
+      m_success = m_format->readFile(m_fileName.toLocal8Bit().data(),
+                                     *m_molecule);
+    }
+
+    if (m_canceled) {
+      m_success = false;
+      m_error = tr("Canceled");
+    } else if (!m_success && m_error.isEmpty()) {
       m_error = QString::fromStdString(m_format->error());
+    } else if (m_success && !cached && elapsed.elapsed() >= slowRead) {
+      // The frames are in the caller's molecule by now, see cacheFrames().
+      if (m_frameCount > 0)
+        m_cacheFrames = true;
+      else
+        cache.store(m_fileName, reader, m_cubes ? *m_cubes : *m_molecule);
+    }
   }
 
   emit finished();
 }
 
+void BackgroundFileFormat::readStream(std::streambuf* source, int codec,
+                                      Core::Molecule& molecule)
+{
+  auto compression = static_cast<CompressedStreamBuf::Codec>(codec);
+  if (compression == CompressedStreamBuf::None) {
+    std::istream stream(source);
+    m_success = m_format->read(stream, molecule);
+    return;
+  }
+
+  if (!CompressedStreamBuf::isSupported(compression)) {
+    m_error = tr("“%1” is compressed with %2, which is not supported.")
+                .arg(m_fileName, CompressedStreamBuf::codecName(compression));
+    return;
+  }
+  CompressedStreamBuf buffer(source, compression, std::ios_base::in);
+  std::istream stream(&buffer);
+  m_success = m_format->read(stream, molecule);
+  if (!buffer.isValid() && !m_canceled) {
+    m_success = false;
+    m_error = tr("“%1” is corrupt or truncated.").arg(m_fileName);
+  }
+}
+
+void BackgroundFileFormat::setMemoryMapping(bool enable)
+{
+  useMemoryMapping = enable;
+}
+
+bool BackgroundFileFormat::memoryMapping()
+{
+  return useMemoryMapping;
+}
+
+void BackgroundFileFormat::setDeferredCubes(bool enable)
+{
+  useDeferredCubes = enable;
+}
+
+bool BackgroundFileFormat::deferredCubes()
+{
+  return useDeferredCubes;
+}
+
+void BackgroundFileFormat::readFrames(QFile& file, const uchar* mapped)
+{
+  // The records are delimited line by line, from memory if mapped.
+  QByteArray data;
+  QBuffer buffer(&data);
+#if QT_VERSION < QT_VERSION_CHECK(6, 0, 0)
+  // A QByteArray cannot hold more than 2 GiB in Qt 5.
+  if (file.size() > std::numeric_limits<int>::max())
+    mapped = nullptr;
+#endif
+  if (mapped) {
+    data = QByteArray::fromRawData(reinterpret_cast<const char*>(mapped),
+                                   file.size());
+    buffer.open(QIODevice::ReadOnly);
+  }
+
+  size_t atomCount = 0;
+  bool valid = RecordIndex::scan(
+    mapped ? static_cast<QIODevice&>(buffer) : file, RecordIndex::Xyz,
+    [&](const RecordIndex::Record& record, const QByteArray& data) {
+      m_bytesProcessed = record.offset + record.length;
+      if (m_canceled)
+        return false;
+
+      // The first frame is read by the file format, with bonds and any
+      // extended XYZ properties.
+      if (m_frameCount == 0) {
+        std::istringstream stream(std::string(data.constData(), data.size()));
+        if (!m_format->read(stream, *m_molecule))
+          return false;
+        atomCount = m_molecule->atomCount();
+        m_frameBytes = record.length;
+        m_frameCount = 1;
+        emit firstFrameRead();
+        return true;
+      }
+
+      // Only the coordinates of the others.
+      QList<QByteArray> lines = data.split('\n');
+      Core::Array<Vector3> positions;
+      positions.reserve(atomCount);
+      for (int i = 2; i < lines.size() && positions.size() < atomCount; ++i) {
+        QList<QByteArray> fields = lines[i].simplified().split(' ');
+        bool ok[3] = { false, false, false };
+        if (fields.size() >= 4) {
+          positions.push_back(Vector3(fields[1].toDouble(&ok[0]),
+                                      fields[2].toDouble(&ok[1]),
+                                      fields[3].toDouble(&ok[2])));
+        }
+        if (!ok[0] || !ok[1] || !ok[2])
+          break;
+      }
+      if (positions.size() != atomCount) {
+        m_error = tr("Frame %1 does not match the first frame.")
+                    .arg(m_frameCount + 1);
+        return false;
+      }
+
+      bool notify = false;
+      {
+        QMutexLocker locker(&m_frameMutex);
+        notify = m_frames.empty();
+        m_frames.push_back(positions);
+      }
+      ++m_frameCount;
+      if (notify)
+        emit framesAvailable();
+      return true;
+    });
+
+  m_success = valid && m_frameCount > 0 && m_error.isEmpty() && !m_canceled;
+}
+
+int BackgroundFileFormat::estimatedFrameCount() const
+{
+  qint64 frameBytes = m_frameBytes.load();
+  if (frameBytes <= 0)
+    return m_frameCount.load();
+  return qMax(m_frameCount.load(),
+              static_cast<int>(m_bytesTotal.load() / frameBytes));
+}
+
+std::vector<Core::Array<Vector3>> BackgroundFileFormat::takeFrames()
+{
+  QMutexLocker locker(&m_frameMutex);
+  std::vector<Core::Array<Vector3>> frames;
+  frames.swap(m_frames);
+  return frames;
+}
+
+void BackgroundFileFormat::cacheFrames(const Core::Molecule& molecule)
+{
+  if (!m_cacheFrames)
+    return;
+
+  m_cacheFrames = false;
+  MoleculeCache::instance().store(
+    m_fileName, QString::fromStdString(m_format->identifier()), molecule);
+}
+
 void BackgroundFileFormat::write()
 {
   m_success = false;
   m_error.clear();
+  m_bytesProcessed = 0;
+  m_bytesTotal = 0;
 
   if (!m_molecule)
     m_error = tr("No molecule set in BackgroundFileFormat!");
@@ -59,15 +389,70 @@ void BackgroundFileFormat::write()
   if (m_fileName.isEmpty())
     m_error = tr("No file name set in BackgroundFileFormat!");
 
+  // Compress when the name asks for it, e.g. "water.cjson.zst".
+  CompressedStreamBuf::Codec codec =
+    CompressedStreamBuf::codecForFileName(m_fileName);
+  bool streams = m_error.isEmpty() &&
+                 m_format->supportedOperations() & Io::FileFormat::Stream;
+  if (m_error.isEmpty() && codec != CompressedStreamBuf::None) {
+    if (!streams)
+      m_error = tr("The file format cannot write compressed files.");
+    else if (!CompressedStreamBuf::isSupported(codec))
+      m_error = tr("This build cannot write %1 compressed files.")
+                  .arg(CompressedStreamBuf::codecName(codec));
+  }
+
   if (m_error.isEmpty()) {
-    m_success = m_format->writeFile(m_fileName.toLocal8Bit().data(),
-                                    *m_molecule);
+    if (streams) {
+      // Written to a temporary file, which replaces the target on success.
+      QSaveFile file(m_fileName);
+      if (file.open(QIODevice::WriteOnly)) {
+        m_bytesTotal = -1;
+        {
+          IODeviceStreamBuf buffer(&file, &m_canceled, &m_bytesProcessed);
+          QScopedPointer<CompressedStreamBuf> compressed;
+          std::streambuf* output = &buffer;
+          if (codec != CompressedStreamBuf::None) {
+            compressed.reset(
+              new CompressedStreamBuf(&buffer, codec, std::ios_base::out));
+            output = compressed.data();
+          }
+          std::ostream stream(output);
+          m_success = m_format->write(stream, *m_molecule);
+          stream.flush();
+          if (compressed)
+            m_success = compressed->finish() && m_success;
+          m_success = m_success && stream.good();
+        }
+        if (m_success && !m_canceled)
+          m_success = file.commit();
+        else
+          file.cancelWriting();
+        if (!m_success && !m_canceled && m_format->error().empty())
+          m_error = file.errorString();
+      } else {
+        m_error = tr("Could not open “%1” for writing: %2")
+                    .arg(m_fileName, file.errorString());
+      }
+    } else {
+      m_success = m_format->writeFile(m_fileName.toLocal8Bit().data(),
+                                      *m_molecule);
+    }
 
-    if (!m_success)
+    if (m_canceled) {
+      m_success = false;
+      m_error = tr("Canceled");
+    } else if (!m_success && m_error.isEmpty()) {
       m_error = QString::fromStdString(m_format->error());
+    }
   }
 
   emit finished();
 }
 
+void BackgroundFileFormat::cancel()
+{
+  m_canceled = true;
+}
+
 } // namespace Avogadro
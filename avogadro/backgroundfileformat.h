@@ -6,9 +6,20 @@
 #ifndef AVOGADRO_BACKGROUNDFILEFORMAT_H
 #define AVOGADRO_BACKGROUNDFILEFORMAT_H
 
+#include <QtCore/QMutex>
 #include <QtCore/QObject>
+#include <QtCore/QScopedPointer>
 #include <QtCore/QString>
 
+#include <avogadro/core/array.h>
+#include <avogadro/core/vector.h>
+
+#include <atomic>
+#include <streambuf>
+#include <vector>
+
+class QFile;
+
 namespace Avogadro {
 
 namespace Core {
@@ -22,6 +33,23 @@ class FileFormat;
 /**
  * @brief The BackgroundFileFormat class provides a thin QObject wrapper around
  * an instance of Io::FileFormat.
+ *
+ * Formats supporting stream operations are read and written through a buffer
+ * that checks the cancel flag before every block, so cancel() stops them
+ * early. Other formats run to completion, their result is then discarded.
+ *
+ * XYZ trajectories are read a frame at a time: the first frame is parsed into
+ * molecule() by the file format and announced with firstFrameRead(), after
+ * which the molecule belongs to the caller. The coordinates of the following
+ * frames are collected for takeFrames() and announced with framesAvailable().
+ *
+ * Gaussian cube files are read in two steps as well: the atoms are parsed from
+ * the header into molecule() and announced with firstFrameRead(), then the
+ * file is read by the file format into cubes(), whose grids the caller moves
+ * to the molecule once finished() was emitted.
+ *
+ * Files that took a while to parse are added to the MoleculeCache, later reads
+ * of the unchanged file with the same format are served from it.
  */
 class BackgroundFileFormat : public QObject
 {
@@ -64,6 +92,71 @@ public:
    */
   QString error() const { return m_error; }
 
+  /**
+   * @return True if cancel() was called.
+   */
+  bool isCanceled() const { return m_canceled.load(); }
+
+  /**
+   * The progress of a running read() or write(), safe to call from any
+   * thread. The total is the file size when reading, and -1 when it is not
+   * known in advance, i.e. when writing. Both are 0 for formats that do not
+   * support stream operations.
+   * @{
+   */
+  qint64 bytesProcessed() const { return m_bytesProcessed.load(); }
+  qint64 bytesTotal() const { return m_bytesTotal.load(); }
+  /**@}*/
+
+  /**
+   * Read stream formats from a read only memory mapping of the file instead
+   * of through a buffer, off by default. The mapping is advised for
+   * sequential access where supported. Applies to all reads started later.
+   * @{
+   */
+  static void setMemoryMapping(bool enable);
+  static bool memoryMapping();
+  /**@}*/
+
+  /**
+   * Show the atoms of Gaussian cube files before their grids are read, on by
+   * default. Applies to all reads started later.
+   * @{
+   */
+  static void setDeferredCubes(bool enable);
+  static bool deferredCubes();
+  /**@}*/
+
+  /**
+   * @return The molecule the cube file was read into after its header, or
+   * nullptr if the file was read in one step. Its cubes are meant to be moved
+   * to molecule(), once finished() was emitted.
+   */
+  Core::Molecule* cubes() const { return m_cubes.data(); }
+
+  /**
+   * The number of frames read so far, and an estimate of the total from the
+   * size of the first frame. Both are 0 unless the file is read frame by
+   * frame.
+   * @{
+   */
+  int frameCount() const { return m_frameCount.load(); }
+  int estimatedFrameCount() const;
+  /**@}*/
+
+  /**
+   * @return The coordinates of the frames read since the last call, in file
+   * order. Thread safe.
+   */
+  std::vector<Core::Array<Vector3>> takeFrames();
+
+  /**
+   * Add @a molecule to the MoleculeCache if the trajectory took a while to
+   * read. Meant for the molecule the frames were moved to with takeFrames(),
+   * once finished() was emitted, rather than keeping a second copy of them.
+   */
+  void cacheFrames(const Core::Molecule& molecule);
+
 signals:
 
   /**
@@ -71,6 +164,19 @@ signals:
    */
   void finished();
 
+  /**
+   * Emitted from the worker once the first frame of a trajectory was read
+   * into molecule(). The molecule must not be used by the worker from then
+   * on, it can be shown while the remaining frames are read.
+   */
+  void firstFrameRead();
+
+  /**
+   * Emitted from the worker when frames are waiting in takeFrames(), once
+   * until they are taken.
+   */
+  void framesAvailable();
+
 public slots:
 
   /**
@@ -83,12 +189,41 @@ public slots:
    */
   void write();
 
+  /**
+   * Ask a running read() or write() to stop. This is thread safe and is meant
+   * to be called directly from the GUI thread, the operation then fails and
+   * finished() is emitted as usual. A canceled write leaves any existing file
+   * unchanged.
+   */
+  void cancel();
+
 private:
+  /**
+   * Read an XYZ trajectory frame by frame from @a file, or from @a mapped if
+   * not null, see firstFrameRead().
+   */
+  void readFrames(QFile& file, const uchar* mapped);
+
+  /**
+   * Read @a molecule from @a source, decompressing it with the
+   * CompressedStreamBuf::Codec @a codec.
+   */
+  void readStream(std::streambuf* source, int codec, Core::Molecule& molecule);
+
   Io::FileFormat* m_format;
   Core::Molecule* m_molecule;
   QString m_fileName;
   QString m_error;
   bool m_success;
+  std::atomic_bool m_canceled;
+  std::atomic<long long> m_bytesProcessed;
+  std::atomic<long long> m_bytesTotal;
+  std::atomic<long long> m_frameBytes;
+  std::atomic_int m_frameCount;
+  QMutex m_frameMutex;
+  std::vector<Core::Array<Vector3>> m_frames;
+  bool m_cacheFrames;
+  QScopedPointer<Core::Molecule> m_cubes;
 };
 
 } // namespace Avogadro
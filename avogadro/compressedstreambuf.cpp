@@ -0,0 +1,527 @@
+/******************************************************************************
+  This source file is part of the Avogadro project.
+  This source code is released under the 3-Clause BSD License, (see "LICENSE").
+******************************************************************************/
+
+#include "compressedstreambuf.h"
+
+#include <QtCore/QFileInfo>
+#include <QtCore/QThread>
+
+#include <cstring>
+#include <limits>
+
+#ifdef AVO_USE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef AVO_USE_ZSTD
+#include <zstd.h>
+#endif
+#ifdef AVO_USE_LZMA
+#include <lzma.h>
+#endif
+
+namespace Avogadro {
+
+namespace {
+const std::size_t blockSize = 1 << 17;
+} // namespace
+
+/**
+ * One direction of one codec. process() consumes from @a in and produces
+ * into @a out, advancing both and decrementing the space left.
+ */
+class CompressedStreamBuf::Engine
+{
+public:
+  enum Result
+  {
+    Ok,
+    StreamEnd,
+    Error
+  };
+
+  virtual ~Engine() {}
+  virtual bool isValid() const = 0;
+  virtual Result process(const char*& in, std::size_t& inLeft, char*& out,
+                         std::size_t& outLeft, bool end) = 0;
+  /** Start over for the next of concatenated streams. */
+  virtual void reset() {}
+};
+
+namespace {
+
+#ifdef AVO_USE_ZLIB
+class GzipEngine : public CompressedStreamBuf::Engine
+{
+public:
+  explicit GzipEngine(bool writing)
+    : m_writing(writing)
+  {
+    std::memset(&m_stream, 0, sizeof(m_stream));
+    // 16 writes a gzip header, 32 detects gzip and zlib headers on input.
+    if (m_writing) {
+      m_valid = deflateInit2(&m_stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                             15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+    } else {
+      m_valid = inflateInit2(&m_stream, 15 + 32) == Z_OK;
+    }
+  }
+
+  ~GzipEngine() override
+  {
+    if (!m_valid)
+      return;
+    if (m_writing)
+      deflateEnd(&m_stream);
+    else
+      inflateEnd(&m_stream);
+  }
+
+  bool isValid() const override { return m_valid; }
+
+  Result process(const char*& in, std::size_t& inLeft, char*& out,
+                 std::size_t& outLeft, bool end) override
+  {
+    m_stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in));
+    m_stream.avail_in = static_cast<uInt>(inLeft);
+    m_stream.next_out = reinterpret_cast<Bytef*>(out);
+    m_stream.avail_out = static_cast<uInt>(outLeft);
+    int ret = m_writing ? deflate(&m_stream, end ? Z_FINISH : Z_NO_FLUSH)
+                        : inflate(&m_stream, Z_NO_FLUSH);
+    in += inLeft - m_stream.avail_in;
+    inLeft = m_stream.avail_in;
+    out += outLeft - m_stream.avail_out;
+    outLeft = m_stream.avail_out;
+
+    if (ret == Z_STREAM_END)
+      return StreamEnd;
+    return ret == Z_OK || ret == Z_BUF_ERROR ? Ok : Error;
+  }
+
+  void reset() override
+  {
+    if (!m_writing)
+      inflateReset(&m_stream);
+  }
+
+private:
+  z_stream m_stream;
+  bool m_writing;
+  bool m_valid;
+};
+#endif
+
+#ifdef AVO_USE_ZSTD
+class ZstdEngine : public CompressedStreamBuf::Engine
+{
+public:
+  explicit ZstdEngine(bool writing)
+    : m_cctx(nullptr), m_dctx(nullptr)
+  {
+    if (writing) {
+      m_cctx = ZSTD_createCCtx();
+      // Fails harmlessly if the library was built without threads.
+      ZSTD_CCtx_setParameter(m_cctx, ZSTD_c_nbWorkers,
+                             qBound(1, QThread::idealThreadCount(), 8));
+    } else {
+      m_dctx = ZSTD_createDCtx();
+    }
+  }
+
+  ~ZstdEngine() override
+  {
+    ZSTD_freeCCtx(m_cctx);
+    ZSTD_freeDCtx(m_dctx);
+  }
+
+  bool isValid() const override { return m_cctx || m_dctx; }
+
+  Result process(const char*& in, std::size_t& inLeft, char*& out,
+                 std::size_t& outLeft, bool end) override
+  {
+    ZSTD_inBuffer input = { in, inLeft, 0 };
+    ZSTD_outBuffer output = { out, outLeft, 0 };
+    std::size_t ret =
+      m_cctx ? ZSTD_compressStream2(m_cctx, &output, &input,
+                                    end ? ZSTD_e_end : ZSTD_e_continue)
+             : ZSTD_decompressStream(m_dctx, &output, &input);
+    in += input.pos;
+    inLeft -= input.pos;
+    out += output.pos;
+    outLeft -= output.pos;
+
+    if (ZSTD_isError(ret))
+      return Error;
+    // A frame was completely flushed, or decoded.
+    if (ret == 0 && (m_dctx || end))
+      return StreamEnd;
+    return Ok;
+  }
+
+  void reset() override
+  {
+    if (m_dctx)
+      ZSTD_DCtx_reset(m_dctx, ZSTD_reset_session_only);
+  }
+
+private:
+  ZSTD_CCtx* m_cctx;
+  ZSTD_DCtx* m_dctx;
+};
+#endif
+
+#ifdef AVO_USE_LZMA
+class XzEngine : public CompressedStreamBuf::Engine
+{
+public:
+  explicit XzEngine(bool writing)
+    : m_stream(LZMA_STREAM_INIT)
+  {
+    lzma_ret ret =
+      writing ? lzma_easy_encoder(&m_stream, 6, LZMA_CHECK_CRC64)
+              : lzma_stream_decoder(&m_stream, UINT64_MAX, LZMA_CONCATENATED);
+    m_valid = ret == LZMA_OK;
+  }
+
+  ~XzEngine() override { lzma_end(&m_stream); }
+
+  bool isValid() const override { return m_valid; }
+
+  Result process(const char*& in, std::size_t& inLeft, char*& out,
+                 std::size_t& outLeft, bool end) override
+  {
+    m_stream.next_in = reinterpret_cast<const uint8_t*>(in);
+    m_stream.avail_in = inLeft;
+    m_stream.next_out = reinterpret_cast<uint8_t*>(out);
+    m_stream.avail_out = outLeft;
+    lzma_ret ret = lzma_code(&m_stream, end ? LZMA_FINISH : LZMA_RUN);
+    in += inLeft - m_stream.avail_in;
+    inLeft = m_stream.avail_in;
+    out += outLeft - m_stream.avail_out;
+    outLeft = m_stream.avail_out;
+
+    if (ret == LZMA_STREAM_END)
+      return StreamEnd;
+    return ret == LZMA_OK || ret == LZMA_BUF_ERROR ? Ok : Error;
+  }
+
+private:
+  lzma_stream m_stream;
+  bool m_valid;
+};
+#endif
+
+CompressedStreamBuf::Engine* createEngine(CompressedStreamBuf::Codec codec,
+                                          bool writing)
+{
+  CompressedStreamBuf::Engine* engine = nullptr;
+  switch (codec) {
+#ifdef AVO_USE_ZLIB
+    case CompressedStreamBuf::Gzip:
+      engine = new GzipEngine(writing);
+      break;
+#endif
+#ifdef AVO_USE_ZSTD
+    case CompressedStreamBuf::Zstd:
+      engine = new ZstdEngine(writing);
+      break;
+#endif
+#ifdef AVO_USE_LZMA
+    case CompressedStreamBuf::Xz:
+      engine = new XzEngine(writing);
+      break;
+#endif
+    default:
+      break;
+  }
+  if (engine && !engine->isValid()) {
+    delete engine;
+    engine = nullptr;
+  }
+  return engine;
+}
+} // namespace
+
+CompressedStreamBuf::CompressedStreamBuf(std::streambuf* device, Codec codec,
+                                         std::ios_base::openmode mode)
+  : m_device(device)
+  , m_codec(codec)
+  , m_engine(nullptr)
+  , m_deviceStart(off_type(-1))
+  , m_position(0)
+  , m_in(blockSize)
+  , m_out(blockSize)
+  , m_inPos(0)
+  , m_inEnd(0)
+  , m_writing((mode & std::ios_base::out) != 0)
+  , m_inputEnd(false)
+  , m_streamEnd(false)
+  , m_finished(false)
+  , m_failed(false)
+{
+  m_engine = createEngine(codec, m_writing);
+  if (m_writing) {
+    setp(m_in.data(), m_in.data() + m_in.size());
+  } else {
+    setg(m_out.data(), m_out.data(), m_out.data());
+    m_deviceStart =
+      m_device->pubseekoff(0, std::ios_base::cur, std::ios_base::in);
+  }
+}
+
+CompressedStreamBuf::~CompressedStreamBuf()
+{
+  if (m_writing)
+    finish();
+  delete m_engine;
+}
+
+CompressedStreamBuf::Codec CompressedStreamBuf::detect(const char* data,
+                                                       std::size_t size)
+{
+  auto startsWith = [=](const char* magic, std::size_t length) {
+    return size >= length && std::memcmp(data, magic, length) == 0;
+  };
+  if (startsWith("\x1f\x8b", 2))
+    return Gzip;
+  if (startsWith("\x28\xb5\x2f\xfd", 4))
+    return Zstd;
+  if (startsWith("\xfd\x37\x7a\x58\x5a\x00", 6))
+    return Xz;
+  return None;
+}
+
+CompressedStreamBuf::Codec CompressedStreamBuf::codecForFileName(
+  const QString& fileName)
+{
+  QString suffix = QFileInfo(fileName).suffix().toLower();
+  if (suffix == "gz")
+    return Gzip;
+  if (suffix == "zst")
+    return Zstd;
+  if (suffix == "xz")
+    return Xz;
+  return None;
+}
+
+QString CompressedStreamBuf::baseFileName(const QString& fileName)
+{
+  if (codecForFileName(fileName) == None)
+    return fileName;
+  return fileName.left(fileName.lastIndexOf('.'));
+}
+
+bool CompressedStreamBuf::isSupported(Codec codec)
+{
+  switch (codec) {
+#ifdef AVO_USE_ZLIB
+    case Gzip:
+      return true;
+#endif
+#ifdef AVO_USE_ZSTD
+    case Zstd:
+      return true;
+#endif
+#ifdef AVO_USE_LZMA
+    case Xz:
+      return true;
+#endif
+    default:
+      return false;
+  }
+}
+
+QString CompressedStreamBuf::codecName(Codec codec)
+{
+  switch (codec) {
+    case Gzip:
+      return QStringLiteral("gzip");
+    case Zstd:
+      return QStringLiteral("zstd");
+    case Xz:
+      return QStringLiteral("xz");
+    default:
+      return QString();
+  }
+}
+
+CompressedStreamBuf::int_type CompressedStreamBuf::underflow()
+{
+  if (gptr() < egptr())
+    return traits_type::to_int_type(*gptr());
+  if (m_writing || !m_engine || m_failed)
+    return traits_type::eof();
+
+  while (true) {
+    if (m_inPos == m_inEnd && !m_inputEnd) {
+      std::streamsize count = m_device->sgetn(
+        m_in.data(), static_cast<std::streamsize>(m_in.size()));
+      m_inPos = 0;
+      m_inEnd = count > 0 ? static_cast<std::size_t>(count) : 0;
+      m_inputEnd = count <= 0;
+    }
+
+    // Another stream may follow the one just ended.
+    if (m_streamEnd) {
+      if (m_inPos == m_inEnd && m_inputEnd)
+        return traits_type::eof();
+      m_engine->reset();
+      m_streamEnd = false;
+    }
+
+    const char* in = m_in.data() + m_inPos;
+    std::size_t inLeft = m_inEnd - m_inPos;
+    char* out = m_out.data();
+    std::size_t outLeft = m_out.size();
+    Engine::Result result =
+      m_engine->process(in, inLeft, out, outLeft, m_inputEnd);
+    std::size_t consumed = (m_inEnd - m_inPos) - inLeft;
+    m_inPos += consumed;
+    std::size_t produced = m_out.size() - outLeft;
+
+    if (result == Engine::Error) {
+      m_failed = true;
+      return traits_type::eof();
+    }
+    m_streamEnd = result == Engine::StreamEnd;
+    if (produced > 0) {
+      m_position += egptr() - eback();
+      setg(m_out.data(), m_out.data(), m_out.data() + produced);
+      return traits_type::to_int_type(*gptr());
+    }
+
+    // All input used without reaching the end: truncated, or canceled.
+    if (!m_streamEnd && m_inputEnd && consumed == 0) {
+      m_failed = true;
+      return traits_type::eof();
+    }
+  }
+}
+
+CompressedStreamBuf::int_type CompressedStreamBuf::overflow(int_type ch)
+{
+  if (!m_writing || m_finished || !compress(false))
+    return traits_type::eof();
+  if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+    *pptr() = traits_type::to_char_type(ch);
+    pbump(1);
+  }
+  return traits_type::not_eof(ch);
+}
+
+int CompressedStreamBuf::sync()
+{
+  // Compressed data is only complete after finish(), flushing the codec here
+  // would cost compression for nothing.
+  return m_failed ? -1 : 0;
+}
+
+CompressedStreamBuf::pos_type CompressedStreamBuf::seekoff(
+  off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which)
+{
+  if (m_writing || !m_engine || !(which & std::ios_base::in))
+    return pos_type(off_type(-1));
+
+  off_type current = m_position + (gptr() - eback());
+  // tellg(), keep the decompressed data.
+  if (off == 0 && dir == std::ios_base::cur)
+    return pos_type(current);
+
+  off_type target = off;
+  if (dir == std::ios_base::cur) {
+    target += current;
+  } else if (dir == std::ios_base::end) {
+    // The size is only known once all of it was decompressed.
+    skipTo(std::numeric_limits<off_type>::max());
+    if (m_failed)
+      return pos_type(off_type(-1));
+    target += m_position + (egptr() - eback());
+  }
+  return seekpos(pos_type(target), which);
+}
+
+CompressedStreamBuf::pos_type CompressedStreamBuf::seekpos(
+  pos_type pos, std::ios_base::openmode which)
+{
+  off_type target = pos;
+  if (m_writing || !m_engine || m_failed || !(which & std::ios_base::in) ||
+      target < 0) {
+    return pos_type(off_type(-1));
+  }
+  if (target < m_position && !rewind())
+    return pos_type(off_type(-1));
+  if (!skipTo(target))
+    return pos_type(off_type(-1));
+  return pos;
+}
+
+bool CompressedStreamBuf::rewind()
+{
+  if (m_deviceStart == pos_type(off_type(-1)) ||
+      m_device->pubseekpos(m_deviceStart, std::ios_base::in) != m_deviceStart) {
+    return false;
+  }
+
+  delete m_engine;
+  m_engine = createEngine(m_codec, false);
+  m_inPos = 0;
+  m_inEnd = 0;
+  m_inputEnd = false;
+  m_streamEnd = false;
+  m_position = 0;
+  setg(m_out.data(), m_out.data(), m_out.data());
+  return m_engine != nullptr;
+}
+
+bool CompressedStreamBuf::skipTo(off_type target)
+{
+  while (true) {
+    off_type end = m_position + (egptr() - eback());
+    if (target <= end) {
+      setg(eback(), eback() + (target - m_position), egptr());
+      return true;
+    }
+    // Drop what is left of the get area, underflow() decompresses the next.
+    setg(eback(), egptr(), egptr());
+    if (traits_type::eq_int_type(underflow(), traits_type::eof()))
+      return false;
+  }
+}
+
+bool CompressedStreamBuf::finish()
+{
+  if (!m_writing || m_finished)
+    return isValid();
+  m_finished = true;
+  if (!compress(true))
+    return false;
+  return m_device->pubsync() == 0;
+}
+
+bool CompressedStreamBuf::compress(bool end)
+{
+  if (!m_engine || m_failed)
+    return false;
+
+  const char* in = pbase();
+  std::size_t inLeft = static_cast<std::size_t>(pptr() - pbase());
+  while (true) {
+    char* out = m_out.data();
+    std::size_t outLeft = m_out.size();
+    Engine::Result result = m_engine->process(in, inLeft, out, outLeft, end);
+    std::streamsize produced =
+      static_cast<std::streamsize>(m_out.size() - outLeft);
+    if (result == Engine::Error ||
+        (produced > 0 && m_device->sputn(m_out.data(), produced) != produced)) {
+      m_failed = true;
+      return false;
+    }
+    if (end ? result == Engine::StreamEnd : inLeft == 0 && outLeft > 0)
+      break;
+  }
+  setp(m_in.data(), m_in.data() + m_in.size());
+  return true;
+}
+
+} // End namespace Avogadro
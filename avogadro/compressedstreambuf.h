@@ -0,0 +1,131 @@
+/******************************************************************************
+  This source file is part of the Avogadro project.
+  This source code is released under the 3-Clause BSD License, (see "LICENSE").
+******************************************************************************/
+
+#ifndef AVOGADRO_COMPRESSEDSTREAMBUF_H
+#define AVOGADRO_COMPRESSEDSTREAMBUF_H
+
+#include <QtCore/QString>
+
+#include <ios>
+#include <streambuf>
+#include <vector>
+
+namespace Avogadro {
+
+/**
+ * @brief The CompressedStreamBuf class decompresses or compresses the data of
+ * another std::streambuf on the fly.
+ *
+ * It is layered on top of IODeviceStreamBuf or MemoryStreamBuf, which keep
+ * handling cancellation and progress, the latter counted in compressed bytes.
+ * gzip, zstd and xz are supported when the corresponding library was found at
+ * build time, see isSupported(). Concatenated streams are read as one.
+ *
+ * Input can be repositioned for formats that seek. Forward seeks decompress
+ * and discard the data in between. Backward seeks rewind the device and
+ * decompress from the start again, so they need a seekable device and are
+ * only as fast as reading up to the target.
+ */
+class CompressedStreamBuf : public std::streambuf
+{
+public:
+  enum Codec
+  {
+    None,
+    Gzip,
+    Zstd,
+    Xz
+  };
+
+  /**
+   * Read compressed data from @a device if @a mode is std::ios_base::in, or
+   * write compressed data to it if it is std::ios_base::out. The device must
+   * outlive the buffer.
+   */
+  CompressedStreamBuf(std::streambuf* device, Codec codec,
+                      std::ios_base::openmode mode);
+  ~CompressedStreamBuf() override;
+
+  /**
+   * @return False if the codec is not supported, or the data was corrupt or
+   * truncated, or writing failed.
+   */
+  bool isValid() const { return m_engine && !m_failed; }
+
+  /**
+   * Compress the remaining data and write the end of the stream. Called by
+   * the destructor, call it first to know whether it succeeded.
+   */
+  bool finish();
+
+  /**
+   * @return The codec whose magic number starts @a data, or None.
+   */
+  static Codec detect(const char* data, std::size_t size);
+
+  /**
+   * @return The codec implied by the last extension of @a fileName, e.g.
+   * Zstd for "water.cjson.zst".
+   */
+  static Codec codecForFileName(const QString& fileName);
+
+  /**
+   * @return @a fileName without the extension of its codec, used to pick
+   * the file format.
+   */
+  static QString baseFileName(const QString& fileName);
+
+  /**
+   * @return True if this build can read and write @a codec.
+   */
+  static bool isSupported(Codec codec);
+
+  /**
+   * @return The usual name of @a codec, for messages.
+   */
+  static QString codecName(Codec codec);
+
+  class Engine;
+
+protected:
+  int_type underflow() override;
+  int_type overflow(int_type ch) override;
+  int sync() override;
+  pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+                   std::ios_base::openmode which) override;
+  pos_type seekpos(pos_type pos, std::ios_base::openmode which) override;
+
+private:
+  std::streambuf* m_device;
+  Codec m_codec;
+  Engine* m_engine;
+  // Where the compressed data starts in the device, -1 if it cannot seek.
+  pos_type m_deviceStart;
+  // The decompressed offset of the start of the get area.
+  off_type m_position;
+  std::vector<char> m_in;
+  std::vector<char> m_out;
+  std::size_t m_inPos;
+  std::size_t m_inEnd;
+  bool m_writing;
+  bool m_inputEnd;
+  bool m_streamEnd;
+  bool m_finished;
+  bool m_failed;
+
+  /** Compress the put area, ending the stream if @a end is true. */
+  bool compress(bool end);
+  /** Start decompressing from the beginning of the device again. */
+  bool rewind();
+  /**
+   * Decompress up to the offset @a target.
+   * @return False if the data ends, or is corrupt, before it.
+   */
+  bool skipTo(off_type target);
+};
+
+} // End namespace Avogadro
+
+#endif // AVOGADRO_COMPRESSEDSTREAMBUF_H
@@ -0,0 +1,135 @@
+/******************************************************************************
+  This source file is part of the Avogadro project.
+  This source code is released under the 3-Clause BSD License, (see "LICENSE").
+******************************************************************************/
+
+#include "filejobqueue.h"
+#include "backgroundfileformat.h"
+
+#include <QtCore/QRunnable>
+#include <QtCore/QThread>
+#include <QtCore/QThreadPool>
+
+namespace Avogadro {
+
+namespace {
+class FileJobRunnable : public QRunnable
+{
+public:
+  FileJobRunnable(FileJobQueue* queue, int id, BackgroundFileFormat* job,
+                  FileJobQueue::Operation op)
+    : m_queue(queue), m_id(id), m_job(job), m_operation(op)
+  {
+  }
+
+  void run() override
+  {
+    if (m_operation == FileJobQueue::Read)
+      m_job->read();
+    else
+      m_job->write();
+
+    // Report from here rather than from the job's finished() signal, the job
+    // is deleted once this is handled and must not be in use any more.
+    QMetaObject::invokeMethod(m_queue, "jobFinished", Qt::QueuedConnection,
+                              Q_ARG(int, m_id));
+  }
+
+private:
+  FileJobQueue* m_queue;
+  int m_id;
+  BackgroundFileFormat* m_job;
+  FileJobQueue::Operation m_operation;
+};
+} // namespace
+
+FileJobQueue::FileJobQueue(QObject* parent)
+  : QObject(parent), m_pool(new QThreadPool(this)), m_nextId(1)
+{
+  // Keep the workers around rather than creating threads for every job. Reads
+  // are mostly parsing, but more than a few workers only contend for the disk.
+  m_pool->setExpiryTimeout(-1);
+  m_pool->setMaxThreadCount(qBound(2, QThread::idealThreadCount(), 4));
+}
+
+FileJobQueue::~FileJobQueue()
+{
+  foreach (BackgroundFileFormat* job, m_jobs)
+    job->cancel();
+  m_pool->waitForDone();
+  qDeleteAll(m_jobs);
+}
+
+int FileJobQueue::read(const QString& fileName, Io::FileFormat* format,
+                       Core::Molecule* molecule)
+{
+  return enqueue(Read, fileName, format, molecule);
+}
+
+int FileJobQueue::write(const QString& fileName, Io::FileFormat* format,
+                        Core::Molecule* molecule)
+{
+  return enqueue(Write, fileName, format, molecule);
+}
+
+void FileJobQueue::cancel(int id)
+{
+  if (BackgroundFileFormat* fileJob = job(id))
+    fileJob->cancel();
+}
+
+int FileJobQueue::count(Operation op) const
+{
+  int result = 0;
+  foreach (int id, m_active) {
+    if (m_operations.value(id) == op)
+      ++result;
+  }
+  return result;
+}
+
+void FileJobQueue::setMaxThreadCount(int count)
+{
+  m_pool->setMaxThreadCount(count);
+}
+
+int FileJobQueue::maxThreadCount() const
+{
+  return m_pool->maxThreadCount();
+}
+
+int FileJobQueue::enqueue(Operation op, const QString& fileName,
+                          Io::FileFormat* format, Core::Molecule* molecule)
+{
+  int id = m_nextId++;
+  auto* fileJob = new BackgroundFileFormat(format);
+  fileJob->setFileName(fileName);
+  fileJob->setMolecule(molecule);
+  m_jobs.insert(id, fileJob);
+  m_operations.insert(id, op);
+  m_active.insert(id);
+
+  // Relay the partial results of trajectories, queued to this thread.
+  connect(fileJob, &BackgroundFileFormat::firstFrameRead, this, [this, id]() {
+    if (m_active.contains(id))
+      emit firstFrameRead(id);
+  });
+  connect(fileJob, &BackgroundFileFormat::framesAvailable, this, [this, id]() {
+    if (m_active.contains(id))
+      emit framesAvailable(id);
+  });
+
+  m_pool->start(new FileJobRunnable(this, id, fileJob, op));
+  return id;
+}
+
+void FileJobQueue::jobFinished(int id)
+{
+  if (!m_active.remove(id))
+    return;
+  emit finished(id);
+  m_operations.remove(id);
+  delete m_jobs.take(id);
+}
+
+} // End namespace Avogadro
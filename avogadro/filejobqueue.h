@@ -0,0 +1,134 @@
+/******************************************************************************
+  This source file is part of the Avogadro project.
+  This source code is released under the 3-Clause BSD License, (see "LICENSE").
+******************************************************************************/
+
+#ifndef AVOGADRO_FILEJOBQUEUE_H
+#define AVOGADRO_FILEJOBQUEUE_H
+
+#include <QtCore/QMap>
+#include <QtCore/QObject>
+#include <QtCore/QSet>
+#include <QtCore/QString>
+
+class QThreadPool;
+
+namespace Avogadro {
+
+class BackgroundFileFormat;
+
+namespace Core {
+class Molecule;
+}
+
+namespace Io {
+class FileFormat;
+}
+
+/**
+ * @brief The FileJobQueue class runs file reads and writes on a small pool of
+ * long lived worker threads.
+ *
+ * Each operation is a job with its own ID, wrapped in a BackgroundFileFormat
+ * that holds its progress, cancel flag and result. Jobs beyond the number of
+ * workers wait in the queue, so loads and saves can overlap without creating
+ * a thread per operation.
+ */
+class FileJobQueue : public QObject
+{
+  Q_OBJECT
+
+public:
+  enum Operation
+  {
+    Read,
+    Write
+  };
+
+  explicit FileJobQueue(QObject* parent = nullptr);
+  /** Cancels the remaining jobs and waits for the running ones. */
+  ~FileJobQueue() override;
+
+  /**
+   * Queue a job that reads @a fileName into @a molecule, or writes
+   * @a molecule to @a fileName, using @a format. The queue takes ownership of
+   * @a format, the molecule must outlive the job.
+   * @return The ID of the job.
+   * @{
+   */
+  int read(const QString& fileName, Io::FileFormat* format,
+           Core::Molecule* molecule);
+  int write(const QString& fileName, Io::FileFormat* format,
+            Core::Molecule* molecule);
+  /**@}*/
+
+  /**
+   * @return The state of the job @a id, or nullptr if it is unknown. The
+   * object is deleted once finished() was handled.
+   */
+  BackgroundFileFormat* job(int id) const { return m_jobs.value(id); }
+
+  /**
+   * @return The operation of the job @a id.
+   */
+  Operation operation(int id) const { return m_operations.value(id, Read); }
+
+  /**
+   * Ask the job @a id to stop, see BackgroundFileFormat::cancel().
+   */
+  void cancel(int id);
+
+  /**
+   * @return The number of queued and running jobs of type @a op.
+   */
+  int count(Operation op) const;
+
+  /**
+   * The number of worker threads, between 2 and 4 depending on the number of
+   * processor cores.
+   * @{
+   */
+  void setMaxThreadCount(int count);
+  int maxThreadCount() const;
+  /**@}*/
+
+  /**
+   * @return The pool of I/O workers, for other file work that should share
+   * the workers with the reads and writes rather than compete with them.
+   */
+  QThreadPool* threadPool() const { return m_pool; }
+
+signals:
+  /**
+   * Emitted in the thread of the queue when the job @a id has finished,
+   * successfully or not. The job is still available from job() while the
+   * signal is handled.
+   */
+  void finished(int id);
+
+  /**
+   * Relayed from BackgroundFileFormat for the read @a id, in the thread of
+   * the queue. Both are emitted before finished().
+   * @{
+   */
+  void firstFrameRead(int id);
+  void framesAvailable(int id);
+  /**@}*/
+
+private slots:
+  void jobFinished(int id);
+
+private:
+  QThreadPool* m_pool;
+  QMap<int, BackgroundFileFormat*> m_jobs;
+  QMap<int, Operation> m_operations;
+  QSet<int> m_active;
+  int m_nextId;
+
+  int enqueue(Operation op, const QString& fileName, Io::FileFormat* format,
+              Core::Molecule* molecule);
+};
+
+} // End namespace Avogadro
+
+#endif // AVOGADRO_FILEJOBQUEUE_H
@@ -0,0 +1,67 @@
+/******************************************************************************
+  This source file is part of the Avogadro project.
+  This source code is released under the 3-Clause BSD License, (see "LICENSE").
+******************************************************************************/
+
+#include "idletaskqueue.h"
+#include "startupprofiler.h"
+
+#include <QtCore/QTimer>
+
+namespace Avogadro {
+
+IdleTaskQueue::IdleTaskQueue(QObject* parent)
+  : QObject(parent)
+  , m_timer(new QTimer(this))
+{
+  // A zero timeout fires whenever the event loop has nothing else to do.
+  m_timer->setInterval(0);
+  connect(m_timer, &QTimer::timeout, this, &IdleTaskQueue::runNext);
+}
+
+IdleTaskQueue::~IdleTaskQueue() = default;
+
+void IdleTaskQueue::post(const QString& name,
+                         const std::function<void()>& task)
+{
+  Task entry;
+  entry.name = name;
+  entry.run = task;
+  m_tasks.enqueue(entry);
+}
+
+void IdleTaskQueue::start()
+{
+  if (!m_tasks.isEmpty())
+    m_timer->start();
+  else
+    emit finished();
+}
+
+void IdleTaskQueue::flush()
+{
+  bool pending = !m_tasks.isEmpty();
+  m_timer->stop();
+  while (!m_tasks.isEmpty()) {
+    Task task = m_tasks.dequeue();
+    StartupProfiler::Scope scope(task.name, "idle");
+    task.run();
+  }
+  if (pending)
+    emit finished();
+}
+
+void IdleTaskQueue::runNext()
+{
+  if (!m_tasks.isEmpty()) {
+    Task task = m_tasks.dequeue();
+    StartupProfiler::Scope scope(task.name, "idle");
+    task.run();
+  }
+  if (m_tasks.isEmpty()) {
+    m_timer->stop();
+    emit finished();
+  }
+}
+
+} // End namespace Avogadro
@@ -0,0 +1,79 @@
+/******************************************************************************
+  This source file is part of the Avogadro project.
+  This source code is released under the 3-Clause BSD License, (see "LICENSE").
+******************************************************************************/
+
+#ifndef AVOGADRO_IDLETASKQUEUE_H
+#define AVOGADRO_IDLETASKQUEUE_H
+
+#include <QtCore/QObject>
+#include <QtCore/QQueue>
+#include <QtCore/QString>
+
+#include <functional>
+
+class QTimer;
+
+namespace Avogadro {
+
+/**
+ * @brief The IdleTaskQueue class runs deferred start up work once the main
+ * window is on screen.
+ *
+ * Tasks are run in the order they were posted, one per pass of the event loop
+ * so that input and painting are handled in between. Each task is recorded as
+ * an "idle" phase by the StartupProfiler.
+ */
+class IdleTaskQueue : public QObject
+{
+  Q_OBJECT
+
+public:
+  explicit IdleTaskQueue(QObject* parent = nullptr);
+  ~IdleTaskQueue() override;
+
+  /**
+   * Add @a task, described by @a name, to the queue. Tasks posted after
+   * start() are run once the queued ones are done.
+   */
+  void post(const QString& name, const std::function<void()>& task);
+
+  /**
+   * Start running the tasks from the event loop.
+   */
+  void start();
+
+  /**
+   * Run all remaining tasks now, e.g. when their results are needed before
+   * the event loop got to them.
+   */
+  void flush();
+
+  /**
+   * @return True if no tasks are waiting.
+   */
+  bool isEmpty() const { return m_tasks.isEmpty(); }
+
+signals:
+  /**
+   * Emitted when the last task has run.
+   */
+  void finished();
+
+private slots:
+  void runNext();
+
+private:
+  struct Task
+  {
+    QString name;
+    std::function<void()> run;
+  };
+
+  QQueue<Task> m_tasks;
+  QTimer* m_timer;
+};
+
+} // End namespace Avogadro
+
+#endif // AVOGADRO_IDLETASKQUEUE_H
@@ -0,0 +1,134 @@
+/******************************************************************************
+  This source file is part of the Avogadro project.
+  This source code is released under the 3-Clause BSD License, (see "LICENSE").
+******************************************************************************/
+
+#include "iodevicestreambuf.h"
+
+#include <QtCore/QIODevice>
+
+namespace Avogadro {
+
+IODeviceStreamBuf::IODeviceStreamBuf(QIODevice* device,
+                                     const std::atomic_bool* canceled,
+                                     std::atomic<long long>* bytes,
+                                     std::size_t blockSize)
+  : m_device(device)
+  , m_canceled(canceled)
+  , m_bytes(bytes)
+  , m_count(0)
+  , m_buffer(blockSize)
+  , m_writing(device->isWritable() && !device->isReadable())
+  , m_wasCanceled(false)
+{
+  char* base = m_buffer.data();
+  if (m_writing)
+    setp(base, base + m_buffer.size());
+  else
+    setg(base, base, base);
+}
+
+IODeviceStreamBuf::~IODeviceStreamBuf()
+{
+  if (m_writing)
+    sync();
+}
+
+bool IODeviceStreamBuf::isCanceled()
+{
+  if (m_canceled && m_canceled->load())
+    m_wasCanceled = true;
+  return m_wasCanceled;
+}
+
+IODeviceStreamBuf::int_type IODeviceStreamBuf::underflow()
+{
+  if (gptr() < egptr())
+    return traits_type::to_int_type(*gptr());
+  if (m_writing || isCanceled())
+    return traits_type::eof();
+
+  char* base = m_buffer.data();
+  qint64 count = m_device->read(base, static_cast<qint64>(m_buffer.size()));
+  if (count <= 0)
+    return traits_type::eof();
+  setg(base, base, base + count);
+  m_count += count;
+  if (m_bytes)
+    m_bytes->store(m_count);
+  return traits_type::to_int_type(*gptr());
+}
+
+IODeviceStreamBuf::int_type IODeviceStreamBuf::overflow(int_type ch)
+{
+  if (!m_writing || !flushBuffer())
+    return traits_type::eof();
+  if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+    *pptr() = traits_type::to_char_type(ch);
+    pbump(1);
+  }
+  return traits_type::not_eof(ch);
+}
+
+int IODeviceStreamBuf::sync()
+{
+  if (!m_writing)
+    return 0;
+  return flushBuffer() ? 0 : -1;
+}
+
+bool IODeviceStreamBuf::flushBuffer()
+{
+  if (isCanceled())
+    return false;
+  qint64 count = pptr() - pbase();
+  if (count > 0 && m_device->write(pbase(), count) != count)
+    return false;
+  m_count += count;
+  if (m_bytes)
+    m_bytes->store(m_count);
+  char* base = m_buffer.data();
+  setp(base, base + m_buffer.size());
+  return true;
+}
+
+IODeviceStreamBuf::pos_type IODeviceStreamBuf::seekoff(
+  off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which)
+{
+  if (m_writing) {
+    // Only reporting the position is supported.
+    if (off != 0 || dir != std::ios_base::cur)
+      return pos_type(off_type(-1));
+    return pos_type(m_device->pos() + (pptr() - pbase()));
+  }
+
+  qint64 current = m_device->pos() - (egptr() - gptr());
+  // tellg(), keep the buffered data.
+  if (off == 0 && dir == std::ios_base::cur)
+    return pos_type(current);
+
+  qint64 target = off;
+  if (dir == std::ios_base::cur)
+    target += current;
+  else if (dir == std::ios_base::end)
+    target += m_device->size();
+  return seekpos(pos_type(target), which);
+}
+
+IODeviceStreamBuf::pos_type IODeviceStreamBuf::seekpos(
+  pos_type pos, std::ios_base::openmode)
+{
+  if (m_writing || m_device->isSequential() ||
+      !m_device->seek(static_cast<qint64>(pos))) {
+    return pos_type(off_type(-1));
+  }
+  // Progress follows the position, formats may skip or rewind.
+  m_count = static_cast<qint64>(pos);
+  if (m_bytes)
+    m_bytes->store(m_count);
+  char* base = m_buffer.data();
+  setg(base, base, base);
+  return pos;
+}
+
+} // End namespace Avogadro
@@ -0,0 +1,70 @@
+/******************************************************************************
+  This source file is part of the Avogadro project.
+  This source code is released under the 3-Clause BSD License, (see "LICENSE").
+******************************************************************************/
+
+#ifndef AVOGADRO_IODEVICESTREAMBUF_H
+#define AVOGADRO_IODEVICESTREAMBUF_H
+
+#include <atomic>
+#include <streambuf>
+#include <vector>
+
+class QIODevice;
+
+namespace Avogadro {
+
+/**
+ * @brief The IODeviceStreamBuf class adapts a QIODevice to a std::streambuf,
+ * so the stream based Io::FileFormat API can read from and write to it.
+ *
+ * The device is read or written in blocks. Before each block the optional
+ * cancel flag is checked, and once it is set the buffer reports end of file
+ * on input and an error on output, so the format stops at its next access.
+ * After each block the optional byte counter is updated, it can be read from
+ * another thread to show progress. The device must stay open for the lifetime
+ * of the buffer.
+ */
+class IODeviceStreamBuf : public std::streambuf
+{
+public:
+  /**
+   * Wrap @a device, which must be open for reading or for writing. If
+   * @a canceled is not null it is checked before every block, if @a bytes is
+   * not null it is set to the number of bytes read or written so far.
+   */
+  explicit IODeviceStreamBuf(QIODevice* device,
+                             const std::atomic_bool* canceled = nullptr,
+                             std::atomic<long long>* bytes = nullptr,
+                             std::size_t blockSize = 65536);
+  ~IODeviceStreamBuf() override;
+
+  /**
+   * @return True if a read or write was refused because of the cancel flag.
+   */
+  bool wasCanceled() const { return m_wasCanceled; }
+
+protected:
+  int_type underflow() override;
+  int_type overflow(int_type ch) override;
+  int sync() override;
+  pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+                   std::ios_base::openmode which) override;
+  pos_type seekpos(pos_type pos, std::ios_base::openmode which) override;
+
+private:
+  QIODevice* m_device;
+  const std::atomic_bool* m_canceled;
+  std::atomic<long long>* m_bytes;
+  long long m_count;
+  std::vector<char> m_buffer;
+  bool m_writing;
+  bool m_wasCanceled;
+
+  bool isCanceled();
+  bool flushBuffer();
+};
+
+} // End namespace Avogadro
+
+#endif // AVOGADRO_IODEVICESTREAMBUF_H
@@ -0,0 +1,487 @@
+/******************************************************************************
+  This source file is part of the Avogadro project.
+  This source code is released under the 3-Clause BSD License, (see "LICENSE").
+******************************************************************************/
+
+#include "librarymodel.h"
+
+#include <avogadro/core/molecule.h>
+#include <avogadro/io/fileformat.h>
+#include <avogadro/io/fileformatmanager.h>
+
+#include <QtConcurrent/QtConcurrentRun>
+#include <QtCore/QCoreApplication>
+#include <QtCore/QDir>
+#include <QtCore/QDirIterator>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QList>
+#include <QtCore/QPointer>
+#include <QtCore/QScopedPointer>
+#include <QtCore/QThread>
+#include <QtCore/QThreadPool>
+
+#include <limits>
+#include <string>
+#include <vector>
+
+namespace Avogadro {
+
+namespace {
+// Records are handed to the model in batches, so the view fills while the
+// file is scanned without an event per record.
+const int batchSize = 1000;
+
+// The files of folders are picked by the first format reading the extension.
+Io::FileFormat* formatForFile(const QString& fileName)
+{
+  std::vector<const Io::FileFormat*> formats =
+    Io::FileFormatManager::instance().fileFormatsFromFileExtension(
+      QFileInfo(fileName).suffix().toLower().toStdString(),
+      Io::FileFormat::Read | Io::FileFormat::File);
+  return formats.empty() ? nullptr : formats.front()->newInstance();
+}
+
+QString recordName(RecordIndex::Layout layout, const QByteArray& data)
+{
+  QList<QByteArray> lines = data.left(4096).split('\n');
+  switch (layout) {
+    case RecordIndex::Sdf:
+      return QString::fromUtf8(lines.value(0).trimmed());
+    case RecordIndex::Xyz:
+      return QString::fromUtf8(lines.value(1).trimmed());
+    case RecordIndex::Pdb:
+      foreach (const QByteArray& line, lines) {
+        if (line.startsWith("MODEL"))
+          return QCoreApplication::translate("LibraryModel", "Model %1")
+            .arg(QString::fromLatin1(line.mid(5).trimmed()));
+      }
+      return QString();
+    default:
+      return QString();
+  }
+}
+
+int recordAtoms(RecordIndex::Layout layout, const QByteArray& data)
+{
+  switch (layout) {
+    case RecordIndex::Sdf: {
+      // The counts line, or the counts of a V3000 connection table.
+      QList<QByteArray> lines = data.split('\n');
+      QByteArray counts = lines.value(3);
+      if (!counts.contains("V3000"))
+        return counts.left(3).trimmed().toInt();
+      foreach (const QByteArray& line, lines) {
+        if (line.startsWith("M  V30 COUNTS"))
+          return line.simplified().split(' ').value(3).toInt();
+      }
+      return -1;
+    }
+    case RecordIndex::Xyz:
+      return data.left(data.indexOf('\n')).trimmed().toInt();
+    case RecordIndex::Pdb: {
+      int atoms = 0;
+      foreach (const QByteArray& line, data.split('\n')) {
+        if (line.startsWith("ATOM  ") || line.startsWith("HETATM"))
+          ++atoms;
+      }
+      return atoms;
+    }
+    default:
+      return -1;
+  }
+}
+} // namespace
+
+LibraryModel::LibraryModel(QObject* parent)
+  : QAbstractTableModel(parent)
+  , m_pool(new QThreadPool(this))
+  , m_indexPool(new QThreadPool(this))
+  , m_molecules(64)
+  , m_canceled(std::make_shared<std::atomic_bool>(false))
+  , m_indexing(0)
+{
+  // Reading whole files is mostly parsing, leave cores for the interface.
+  m_indexPool->setMaxThreadCount(qBound(1, QThread::idealThreadCount() / 2, 4));
+}
+
+LibraryModel::~LibraryModel()
+{
+  // The scans check the flag between records and files.
+  *m_canceled = true;
+  m_pool->waitForDone();
+  m_indexPool->waitForDone();
+}
+
+bool LibraryModel::addFile(const QString& fileName, Io::FileFormat* format)
+{
+  RecordIndex::Layout layout = RecordIndex::layoutForFile(fileName);
+  if (layout == RecordIndex::Unknown || !format) {
+    delete format;
+    return false;
+  }
+
+  int source = m_sources.size();
+  m_sources.append(
+    { fileName, layout, std::shared_ptr<Io::FileFormat>(format) });
+  ++m_indexing;
+
+  QPointer<LibraryModel> model(this);
+  std::shared_ptr<std::atomic_bool> canceled = m_canceled;
+  QtConcurrent::run(m_pool, [model, canceled, fileName, layout, source]() {
+    QVector<Entry> batch;
+    int count = 0;
+    auto post = [&](bool done) {
+      QMetaObject::invokeMethod(
+        qApp,
+        [model, canceled, batch, fileName, count, done]() {
+          // Scans of a cleared model are dropped.
+          if (!model || *canceled)
+            return;
+          model->appendEntries(batch);
+          if (done) {
+            --model->m_indexing;
+            emit model->indexed(fileName, count);
+          }
+        },
+        Qt::QueuedConnection);
+      batch.clear();
+    };
+
+    QFile file(fileName);
+    if (file.open(QIODevice::ReadOnly)) {
+      RecordIndex::scan(
+        file, layout,
+        [&](const RecordIndex::Record& record, const QByteArray& data) {
+          if (*canceled)
+            return false;
+          batch.append({ source, count, record, recordName(layout, data),
+                         recordAtoms(layout, data), QString(), QString() });
+          ++count;
+          if (batch.size() >= batchSize)
+            post(false);
+          return true;
+        });
+    }
+    post(true);
+  });
+  return true;
+}
+
+void LibraryModel::addFolder(const QString& path)
+{
+  // Compressed files are left out, not every format can read them.
+  QStringList filters;
+  std::vector<std::string> extensions =
+    Io::FileFormatManager::instance().fileExtensions(Io::FileFormat::Read |
+                                                     Io::FileFormat::File);
+  for (const std::string& extension : extensions)
+    filters << "*." + QString::fromStdString(extension);
+
+  int source = m_sources.size();
+  m_sources.append({ path, RecordIndex::Unknown, nullptr });
+  ++m_indexing;
+
+  QPointer<LibraryModel> model(this);
+  std::shared_ptr<std::atomic_bool> canceled = m_canceled;
+  QtConcurrent::run(m_pool, [model, canceled, path, filters, source]() {
+    QVector<Entry> batch;
+    int count = 0;
+    auto post = [&](bool done) {
+      QMetaObject::invokeMethod(
+        qApp,
+        [model, canceled, batch, path, count, done]() {
+          if (!model || *canceled)
+            return;
+          // The files are summarized while the folder is still listed.
+          int first = model->m_entries.size();
+          model->appendEntries(batch);
+          model->summarize(first, model->m_entries.size() - 1);
+          if (done) {
+            --model->m_indexing;
+            emit model->indexed(path, count);
+          }
+        },
+        Qt::QueuedConnection);
+      batch.clear();
+    };
+
+    QDir dir(path);
+    QDirIterator it(path, filters, QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext() && !*canceled) {
+      QString fileName = it.next();
+      batch.append({ source, count, { 0, -1 }, dir.relativeFilePath(fileName),
+                     -1, fileName, QString() });
+      ++count;
+      if (batch.size() >= batchSize)
+        post(false);
+    }
+    post(true);
+  });
+}
+
+void LibraryModel::summarize(int first, int last)
+{
+  if (last < first)
+    return;
+
+  auto files = std::make_shared<QStringList>();
+  for (int row = first; row <= last; ++row)
+    files->append(m_entries.at(row).fileName);
+
+  // A few workers take the files in turn, so a folder never keeps more than
+  // indexThreadCount() threads busy.
+  auto next = std::make_shared<std::atomic_int>(0);
+  QPointer<LibraryModel> model(this);
+  std::shared_ptr<std::atomic_bool> canceled = m_canceled;
+  int workers = qMin(m_indexPool->maxThreadCount(), files->size());
+  for (int i = 0; i < workers; ++i) {
+    QtConcurrent::run(m_indexPool, [model, canceled, files, next, first]() {
+      QVector<Summary> batch;
+      QElapsedTimer timer;
+      timer.start();
+      auto post = [&]() {
+        QMetaObject::invokeMethod(
+          qApp,
+          [model, canceled, batch]() {
+            if (model && !*canceled)
+              model->applySummaries(batch);
+          },
+          Qt::QueuedConnection);
+        batch.clear();
+        timer.restart();
+      };
+
+      for (int i = (*next)++; i < files->size() && !*canceled; i = (*next)++) {
+        const QString& fileName = files->at(i);
+        Summary summary = { first + i, -1, QString() };
+        QScopedPointer<Io::FileFormat> format(formatForFile(fileName));
+        Core::Molecule molecule;
+        if (format &&
+            format->readFile(fileName.toLocal8Bit().data(), molecule)) {
+          summary.atomCount = static_cast<int>(molecule.atomCount());
+          summary.formula = QString::fromStdString(molecule.formula());
+        }
+        batch.append(summary);
+        // Often enough for the view to fill steadily.
+        if (timer.elapsed() >= 250)
+          post();
+      }
+      if (!batch.isEmpty())
+        post();
+    });
+  }
+}
+
+void LibraryModel::applySummaries(const QVector<Summary>& summaries)
+{
+  int first = std::numeric_limits<int>::max();
+  int last = -1;
+  foreach (const Summary& summary, summaries) {
+    if (summary.row >= m_entries.size())
+      continue;
+    Entry& entry = m_entries[summary.row];
+    entry.atomCount = summary.atomCount;
+    entry.formula = summary.formula;
+    first = qMin(first, summary.row);
+    last = qMax(last, summary.row);
+  }
+  if (last >= 0)
+    emit dataChanged(index(first, AtomsColumn), index(last, FormulaColumn));
+}
+
+void LibraryModel::appendEntries(const QVector<Entry>& entries)
+{
+  if (entries.isEmpty())
+    return;
+
+  beginInsertRows(QModelIndex(), m_entries.size(),
+                  m_entries.size() + entries.size() - 1);
+  m_entries += entries;
+  endInsertRows();
+}
+
+void LibraryModel::clear()
+{
+  beginResetModel();
+  *m_canceled = true;
+  m_canceled = std::make_shared<std::atomic_bool>(false);
+  m_sources.clear();
+  m_entries.clear();
+  m_molecules.clear();
+  m_reading.clear();
+  m_indexing = 0;
+  endResetModel();
+}
+
+const Core::Molecule* LibraryModel::molecule(int row)
+{
+  m_error.clear();
+  if (row < 0 || row >= m_entries.size()) {
+    m_error = tr("There is no record %1.").arg(row + 1);
+    return nullptr;
+  }
+  if (Core::Molecule* molecule = m_molecules.object(row))
+    return molecule;
+
+  const Entry& entry = m_entries.at(row);
+  if (!entry.fileName.isEmpty()) {
+    readFile(row, entry.fileName);
+    return nullptr;
+  }
+
+  const Source& source = m_sources.at(entry.source);
+  QFile file(source.fileName);
+  if (!file.open(QIODevice::ReadOnly) || !file.seek(entry.record.offset)) {
+    m_error = file.errorString();
+    return nullptr;
+  }
+  QByteArray data = file.read(entry.record.length);
+  if (data.size() != entry.record.length) {
+    m_error = tr("“%1” changed since it was indexed.").arg(source.fileName);
+    return nullptr;
+  }
+
+  auto* molecule = new Core::Molecule;
+  if (!source.format->readString(std::string(data.constData(), data.size()),
+                                 *molecule)) {
+    m_error = QString::fromStdString(source.format->error());
+    delete molecule;
+    return nullptr;
+  }
+  m_molecules.insert(row, molecule);
+  return molecule;
+}
+
+void LibraryModel::readFile(int row, const QString& fileName)
+{
+  if (m_reading.contains(row))
+    return;
+  m_reading.insert(row);
+
+  // Whole files can take seconds to parse, the result is posted back.
+  QPointer<LibraryModel> model(this);
+  std::shared_ptr<std::atomic_bool> canceled = m_canceled;
+  QtConcurrent::run(m_pool, [model, canceled, row, fileName]() {
+    QScopedPointer<Io::FileFormat> format(formatForFile(fileName));
+    auto* molecule = new Core::Molecule;
+    QString error;
+    if (!format) {
+      error = tr("No file format can read “%1”.").arg(fileName);
+    } else if (!format->readFile(fileName.toLocal8Bit().data(), *molecule)) {
+      error = QString::fromStdString(format->error());
+    }
+    if (!error.isEmpty()) {
+      delete molecule;
+      molecule = nullptr;
+    }
+
+    QMetaObject::invokeMethod(
+      qApp,
+      [model, canceled, row, molecule, error]() {
+        if (!model || *canceled) {
+          delete molecule;
+          return;
+        }
+        model->m_reading.remove(row);
+        if (molecule)
+          model->m_molecules.insert(row, molecule);
+        emit model->moleculeRead(row, error);
+      },
+      Qt::QueuedConnection);
+  });
+}
+
+QString LibraryModel::fileName(int row) const
+{
+  if (row < 0 || row >= m_entries.size())
+    return QString();
+  const Entry& entry = m_entries.at(row);
+  if (!entry.fileName.isEmpty())
+    return entry.fileName;
+  return m_sources.at(entry.source).fileName;
+}
+
+void LibraryModel::setCacheSize(int molecules)
+{
+  m_molecules.setMaxCost(qMax(1, molecules));
+}
+
+int LibraryModel::cacheSize() const
+{
+  return m_molecules.maxCost();
+}
+
+void LibraryModel::setIndexThreadCount(int count)
+{
+  m_indexPool->setMaxThreadCount(qBound(1, count, 4));
+}
+
+int LibraryModel::indexThreadCount() const
+{
+  return m_indexPool->maxThreadCount();
+}
+
+int LibraryModel::rowCount(const QModelIndex& parent) const
+{
+  return parent.isValid() ? 0 : m_entries.size();
+}
+
+int LibraryModel::columnCount(const QModelIndex& parent) const
+{
+  return parent.isValid() ? 0 : ColumnCount;
+}
+
+QVariant LibraryModel::data(const QModelIndex& index, int role) const
+{
+  if (!index.isValid() || index.row() >= m_entries.size())
+    return QVariant();
+
+  const Entry& entry = m_entries.at(index.row());
+  switch (role) {
+    case Qt::DisplayRole:
+      if (index.column() == NameColumn) {
+        if (entry.name.isEmpty())
+          return tr("Record %1").arg(entry.number + 1);
+        return entry.name;
+      }
+      if (index.column() == AtomsColumn && entry.atomCount >= 0)
+        return entry.atomCount;
+      if (index.column() == FormulaColumn)
+        return entry.formula;
+      return QVariant();
+    case Qt::ToolTipRole:
+      if (!entry.fileName.isEmpty())
+        return entry.fileName;
+      return tr("%1, record %2", "%1 = file name, %2 = record number")
+        .arg(QFileInfo(m_sources.at(entry.source).fileName).fileName())
+        .arg(entry.number + 1);
+    case Qt::TextAlignmentRole:
+      if (index.column() == AtomsColumn)
+        return static_cast<int>(Qt::AlignRight | Qt::AlignVCenter);
+      return QVariant();
+    default:
+      return QVariant();
+  }
+}
+
+QVariant LibraryModel::headerData(int section, Qt::Orientation orientation,
+                                  int role) const
+{
+  if (orientation != Qt::Horizontal || role != Qt::DisplayRole)
+    return QVariant();
+
+  switch (section) {
+    case NameColumn:
+      return tr("Name");
+    case AtomsColumn:
+      return tr("Atoms");
+    case FormulaColumn:
+      return tr("Formula");
+    default:
+      return QVariant();
+  }
+}
+
+} // End namespace Avogadro
@@ -0,0 +1,193 @@
+/******************************************************************************
+  This source file is part of the Avogadro project.
+  This source code is released under the 3-Clause BSD License, (see "LICENSE").
+******************************************************************************/
+
+#ifndef AVOGADRO_LIBRARYMODEL_H
+#define AVOGADRO_LIBRARYMODEL_H
+
+#include "recordindex.h"
+
+#include <QtCore/QAbstractTableModel>
+#include <QtCore/QCache>
+#include <QtCore/QSet>
+#include <QtCore/QString>
+#include <QtCore/QVector>
+
+#include <atomic>
+#include <memory>
+
+class QThreadPool;
+
+namespace Avogadro {
+
+namespace Core {
+class Molecule;
+}
+
+namespace Io {
+class FileFormat;
+}
+
+/**
+ * @brief The LibraryModel class lists the records of multi-record files, e.g.
+ * a screening library in one SDF file, and the files of folders, without
+ * reading them.
+ *
+ * The records of each file are delimited by a RecordIndex scan on the I/O
+ * workers, and appear as rows while the scan proceeds. Only their name and
+ * atom count are taken from the text. Folders are listed on the I/O workers
+ * as well, their files are then read by a few indexing threads for their
+ * atom count and formula. A row is parsed when molecule() is first called for
+ * it, the most recently used ones are kept.
+ */
+class LibraryModel : public QAbstractTableModel
+{
+  Q_OBJECT
+
+public:
+  enum Column
+  {
+    NameColumn,
+    AtomsColumn,
+    FormulaColumn,
+    ColumnCount
+  };
+
+  explicit LibraryModel(QObject* parent = nullptr);
+  /** Cancel the scans and wait for them, so none outlives the model. */
+  ~LibraryModel() override;
+
+  /**
+   * Add the records of @a fileName, read with @a format. The model takes
+   * ownership of @a format.
+   * @return False if the layout of the file is not known, see
+   * RecordIndex::layoutForFile().
+   */
+  bool addFile(const QString& fileName, Io::FileFormat* format);
+
+  /**
+   * Add the files in @a path and its subfolders that can be read by a
+   * registered file format, one row per file.
+   */
+  void addFolder(const QString& path);
+
+  /**
+   * Remove all rows, and stop the scans still running.
+   */
+  void clear();
+
+  /**
+   * @return The molecule of @a row, or nullptr if it could not be parsed, see
+   * error(). It is owned by the model and valid until the next call.
+   *
+   * The files of folders are parsed on a worker thread: nullptr is returned
+   * with an empty error() until moleculeRead() is emitted for @a row.
+   */
+  const Core::Molecule* molecule(int row);
+
+  /**
+   * @return Why the last call to molecule() failed.
+   */
+  QString error() const { return m_error; }
+
+  /**
+   * @return The file holding @a row.
+   */
+  QString fileName(int row) const;
+
+  /**
+   * The number of parsed molecules kept, 64 by default.
+   * @{
+   */
+  void setCacheSize(int molecules);
+  int cacheSize() const;
+  /**@}*/
+
+  /**
+   * The number of threads reading the files of folders, between 1 and 4
+   * depending on the number of processor cores.
+   * @{
+   */
+  void setIndexThreadCount(int count);
+  int indexThreadCount() const;
+  /**@}*/
+
+  /**
+   * @return True while files or folders are being scanned.
+   */
+  bool isIndexing() const { return m_indexing > 0; }
+
+  int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+  int columnCount(const QModelIndex& parent = QModelIndex()) const override;
+  QVariant data(const QModelIndex& index,
+                int role = Qt::DisplayRole) const override;
+  QVariant headerData(int section, Qt::Orientation orientation,
+                      int role = Qt::DisplayRole) const override;
+
+signals:
+  /**
+   * Emitted once all records of @a fileName, or all files of the folder
+   * @a fileName, were found.
+   */
+  void indexed(const QString& fileName, int records);
+
+  /**
+   * Emitted once the file of the folder entry @a row was parsed, after which
+   * molecule() returns it. @a error is empty on success.
+   */
+  void moleculeRead(int row, const QString& error);
+
+private:
+  struct Source
+  {
+    QString fileName;
+    RecordIndex::Layout layout;
+    std::shared_ptr<Io::FileFormat> format;
+  };
+
+  struct Entry
+  {
+    int source;
+    // the position of the record in its file
+    int number;
+    RecordIndex::Record record;
+    QString name;
+    int atomCount;
+    // for the files of folders, which are read as a whole
+    QString fileName;
+    QString formula;
+  };
+
+  // What the indexing threads found out about a row.
+  struct Summary
+  {
+    int row;
+    int atomCount;
+    QString formula;
+  };
+
+  // Scans stay off FileJobQueue, which waits for its pool on exit.
+  QThreadPool* m_pool;
+  QThreadPool* m_indexPool;
+  QVector<Source> m_sources;
+  QVector<Entry> m_entries;
+  QCache<int, Core::Molecule> m_molecules;
+  // Shared with the running scans, replaced by clear().
+  std::shared_ptr<std::atomic_bool> m_canceled;
+  int m_indexing;
+  QString m_error;
+  // folder entries being parsed, so a row is not read twice at once
+  QSet<int> m_reading;
+
+  void appendEntries(const QVector<Entry>& entries);
+  /** Read the files of the rows @a first to @a last on the indexing pool. */
+  void summarize(int first, int last);
+  void applySummaries(const QVector<Summary>& summaries);
+  /** Parse the file of the folder entry @a row on the scan pool. */
+  void readFile(int row, const QString& fileName);
+};
+
+} // End namespace Avogadro
+
+#endif // AVOGADRO_LIBRARYMODEL_H
@@ -6,14 +6,24 @@
 #include "mainwindow.h"
 
 #include "aboutdialog.h"
+#include "autosaver.h"
 #include "avogadroappconfig.h"
 #include "backgroundfileformat.h"
+#include "compressedstreambuf.h"
+#include "filejobqueue.h"
+#include "idletaskqueue.h"
+#include "librarymodel.h"
 #include "menubuilder.h"
+#include "moleculecache.h"
+#include "pluginmanifest.h"
+#include "readinessbarrier.h"
 #include "renderingdialog.h"
+#include "startupprofiler.h"
 #include "tdxcontroller.h"
 #include "tooltipfilter.h"
 #include "viewfactory.h"
 
+#include <avogadro/core/cube.h>
 #include <avogadro/core/elements.h>
 #include <avogadro/core/variant.h>
 #include <avogadro/io/cjsonformat.h>
@@ -38,18 +48,23 @@
 #include <avogadro/rendering/glrenderer.h>
 #include <avogadro/rendering/scene.h>
 
+#include <QtCore/QDateTime>
 #include <QtCore/QDebug>
+#include <QtCore/QDir>
+#include <QtCore/QElapsedTimer>
 #include <QtCore/QFile>
 #include <QtCore/QFileInfo>
 #include <QtCore/QJsonDocument>
 #include <QtCore/QJsonObject>
+#include <QtCore/QLocale>
+#include <QtCore/QLoggingCategory>
 #include <QtCore/QMimeData>
 #include <QtCore/QProcess>
 #include <QtCore/QSettings>
 #include <QtCore/QStandardPaths>
 #include <QtCore/QString>
-#include <QtCore/QThread>
 #include <QtCore/QTimer>
+#include <QtCore/QtMath>
 
 #include <QOpenGLFramebufferObject>
 #include <QtGui/QClipboard>
@@ -72,6 +87,7 @@
 #include <QtWidgets/QMenu>
 #include <QtWidgets/QMenuBar>
 #include <QtWidgets/QMessageBox>
+#include <QtWidgets/QProgressBar>
 #include <QtWidgets/QProgressDialog>
 #include <QtWidgets/QPushButton>
 #include <QtWidgets/QStatusBar>
@@ -90,6 +106,12 @@
 
 #ifdef Avogadro_ENABLE_RPC
 #include <molequeue/client/client.h>
+
+#include <QtConcurrent/QtConcurrentRun>
+#include <QtCore/QCryptographicHash>
+#include <QtNetwork/QLocalSocket>
+
+#include <memory>
 #endif // Avogadro_ENABLE_RPC
 
 #ifdef AVO_USE_VTK
@@ -227,23 +249,74 @@ using std::vector;
 using VTK::vtkGLWidget;
 #endif
 
+namespace {
+// The cost of the snapshots taken for saving, enabled with
+// QT_LOGGING_RULES="avogadro.io.save.debug=true".
+Q_LOGGING_CATEGORY(lcSave, "avogadro.io.save", QtWarningMsg)
+
+// Startup timings, enabled with QT_LOGGING_RULES="avogadro.startup.debug=true".
+Q_LOGGING_CATEGORY(lcStartup, "avogadro.startup", QtWarningMsg)
+
+// Add trajectory frames read in the background as coordinate sets.
+bool appendFrames(Molecule* molecule,
+                  const vector<Core::Array<Vector3>>& frames)
+{
+  if (frames.empty())
+    return false;
+
+  // The first frame is the geometry the molecule was read with.
+  if (molecule->coordinate3dCount() == 0)
+    molecule->setCoordinate3d(molecule->atomPositions3d(), 0);
+  for (const auto& frame : frames)
+    molecule->setCoordinate3d(frame, molecule->coordinate3dCount());
+  return true;
+}
+
+// Move the cubes read after the geometry to the molecule shown meanwhile.
+bool appendCubes(Molecule* molecule, Core::Molecule* cubes)
+{
+  if (!cubes || cubes->cubeCount() == 0)
+    return false;
+
+  for (Index i = 0; i < cubes->cubeCount(); ++i) {
+    Core::Cube* source = cubes->cube(i);
+    Core::Cube* cube = molecule->addCube();
+    cube->setName(source->name());
+    cube->setLimits(source->min(), source->dimensions(), source->spacing());
+    cube->data()->swap(*source->data());
+  }
+  return true;
+}
+} // namespace
+
 MainWindow::MainWindow(const QStringList& fileNames, bool disableSettings)
   : m_molecule(nullptr)
   , m_rwMolecule(nullptr)
   , m_moleculeModel(nullptr)
   , m_layerModel(nullptr)
   , m_activeScenePlugin(nullptr)
-  , m_queuedFilesStarted(false)
+  , m_readiness(new ReadinessBarrier(this))
+  , m_idleTasks(new IdleTaskQueue(this))
+  , m_disableSettings(disableSettings)
   , m_menuBuilder(new MenuBuilder)
-  , m_fileReadThread(nullptr)
-  , m_fileWriteThread(nullptr)
-  , m_threadedReader(nullptr)
-  , m_threadedWriter(nullptr)
-  , m_progressDialog(nullptr)
-  , m_fileReadMolecule(nullptr)
+  , m_pluginManifest(new PluginManifest)
+  , m_fileJobs(new FileJobQueue(this))
+  , m_batchProgress(nullptr)
+  , m_batchTotal(0)
+  , m_batchDone(0)
   , m_fileToolBar(new QToolBar(this))
   , m_toolToolBar(new QToolBar(this))
   , m_moleculeDirty(false)
+  , m_readingChanges(false)
+  , m_editGeneration(0)
+  , m_closeAfterSave(false)
+  , m_autoSaver(new AutoSaver(m_fileJobs->threadPool(), this))
+  , m_library(nullptr)
+  , m_libraryDock(nullptr)
+  , m_libraryView(nullptr)
+  , m_libraryFirstRow(-1)
+  , m_libraryReadRow(-1)
+  , m_toolbarToolsUsed(false)
   , m_undo(nullptr)
   , m_redo(nullptr)
   , m_copyImage(nullptr)
@@ -258,67 +331,120 @@ MainWindow::MainWindow(const QStringList& fileNames, bool disableSettings)
     settings.clear();
     settings.sync();
   }
+  StartupProfiler& profiler = StartupProfiler::instance();
+
   // The default settings will be used if everything was cleared.
+  profiler.begin("read settings");
   readSettings();
-
-  // check for version update
-  checkUpdate();
+  profiler.end("read settings");
 
   // Now load the plugins.
+  profiler.begin("plugin load");
   PluginManager* plugin = PluginManager::instance();
   plugin->load();
+  profiler.end("plugin load");
 
-  // Call this a second time, not needed but ensures plugins only load once.
-  plugin->load();
+  // Plugin metadata cached from a previous run, rebuilt if plugins changed.
+  profiler.begin("plugin manifest");
+  if (!disableSettings)
+    m_pluginManifest->load();
+  profiler.end("plugin manifest");
 
   QList<ExtensionPluginFactory*> extensions =
     plugin->pluginFactories<ExtensionPluginFactory>();
   qDebug() << "Extension plugins dynamically found…" << extensions.size();
+  profiler.begin("extensions");
   foreach (ExtensionPluginFactory* factory, extensions) {
-    ExtensionPlugin* extension =
-      factory->createInstance(QCoreApplication::instance());
-    if (extension) {
-      extension->setParent(this);
-      connect(this, &MainWindow::moleculeChanged, extension,
-              &QtGui::ExtensionPlugin::setMolecule);
-      connect(extension, &QtGui::ExtensionPlugin::moleculeReady, this,
-              &MainWindow::moleculeReady);
-      connect(extension, &QtGui::ExtensionPlugin::fileFormatsReady, this,
-              &MainWindow::fileFormatsReady);
-      connect(extension, &QtGui::ExtensionPlugin::requestActiveTool, this,
-              &MainWindow::setActiveTool);
-      connect(extension, &QtGui::ExtensionPlugin::requestActiveDisplayTypes,
-              this, &MainWindow::setActiveDisplayTypes);
-      connect(extension, &QtGui::ExtensionPlugin::registerCommand, this,
-              &MainWindow::registerExtensionCommand);
-      extension->registerCommands();
+    StartupProfiler::Scope scope(factory->identifier(), "extension");
+
+    // Extensions known from the manifest are represented by proxy actions and
+    // command stubs, and created on first use. Extensions providing file
+    // formats must be created now so their formats are registered.
+    const PluginManifest::ExtensionEntry* entry =
+      m_pluginManifest->isValid()
+        ? m_pluginManifest->extension(factory->identifier())
+        : nullptr;
+    if (entry && entry->fileFormats.isEmpty() &&
+        (!entry->actions.isEmpty() || !entry->commands.isEmpty())) {
+      addExtensionProxy(factory, *entry);
+      continue;
+    }
+
+    // Queued files wait for the formats this extension provided last time.
+    if (entry && !entry->fileFormats.isEmpty())
+      m_readiness->addPending(factory->identifier());
 
+    ExtensionPlugin* extension = createExtension(factory);
+    if (extension) {
       buildMenu(extension);
-      m_extensions.append(extension);
+      updatePluginManifest(factory, extension);
     }
   }
+  profiler.end("extensions");
+  qCDebug(lcStartup) << "Extension plugins deferred until first use…"
+                     << m_lazyExtensions.size();
 
   // Now set up the interface.
+  profiler.begin("setupInterface");
   setupInterface();
+  profiler.end("setupInterface");
 
   // Build up the standard menus, incorporate dynamic menus.
+  profiler.begin("buildMenu");
   buildMenu();
   updateRecentFiles();
-
-  // Try to open the file(s) passed in.
-  if (!fileNames.isEmpty()) {
+  profiler.end("buildMenu");
+
+  if (!disableSettings && !m_pluginManifest->isValid()) {
+    QStringList toolIds, sceneIds;
+    foreach (ToolPluginFactory* factory,
+             plugin->pluginFactories<ToolPluginFactory>())
+      toolIds << factory->identifier();
+    foreach (ScenePluginFactory* factory,
+             plugin->pluginFactories<ScenePluginFactory>())
+      sceneIds << factory->identifier();
+    m_pluginManifest->setToolIdentifiers(toolIds);
+    m_pluginManifest->setSceneIdentifiers(sceneIds);
+    m_pluginManifest->save();
+  }
+
+  // Try to open the file(s) passed in, as soon as there is a reader for them.
+  if (!fileNames.isEmpty())
     m_queuedFiles = fileNames;
-    // Give the plugins 5 seconds before timing out queued files.
-    QTimer::singleShot(5000, this, &MainWindow::clearQueuedFiles);
-  } else {
+  else
     newMolecule();
-  }
-
+  connect(m_readiness, &ReadinessBarrier::ready, this,
+          &MainWindow::readQueuedFiles);
+  connect(m_idleTasks, &IdleTaskQueue::finished, this,
+          &MainWindow::finishStartup);
+  connect(m_fileJobs, &FileJobQueue::finished, this,
+          &MainWindow::fileJobFinished);
+  connect(m_fileJobs, &FileJobQueue::firstFrameRead, this,
+          &MainWindow::fileJobFirstFrame);
+  connect(m_fileJobs, &FileJobQueue::framesAvailable, this,
+          &MainWindow::fileJobFrames);
+  // Cache entries are written next to the reads, not on the global pool.
+  MoleculeCache::instance().setThreadPool(m_fileJobs->threadPool());
 #ifdef Avogadro_ENABLE_RPC
-  // Wait a few seconds to attempt registering with MoleQueue.
-  QTimer::singleShot(3000, this, &MainWindow::registerMoleQueue);
+  // Register with MoleQueue once all file formats are known.
+  connect(m_readiness, &ReadinessBarrier::ready, this,
+          &MainWindow::registerMoleQueue);
 #endif // Avogadro_ENABLE_RPC
 
+  // Without a manifest the extensions providing formats are not known. All of
+  // them were created above, wait until the formats they report right away
+  // have been delivered, at the first idle moment. Otherwise the timeout is
+  // only a safety net for a plugin that never reports.
+  if (!m_pluginManifest->isValid()) {
+    const QString manifest = QStringLiteral("plugin manifest");
+    m_readiness->addPending(manifest);
+    m_idleTasks->post(manifest,
+                      [this, manifest]() { m_readiness->markReady(manifest); });
+  }
+  m_readiness->start(m_pluginManifest->isValid() ? 30000 : 5000);
+  // Once the window is usable, after the files passed in were queued.
+  m_idleTasks->post("recovery", [this]() { restoreRecoveredFiles(); });
+
   statusBar()->showMessage(tr("Ready…"), 2000);
 
   updateWindowTitle();
@@ -352,8 +478,10 @@ MainWindow::~MainWindow()
   m_TDxController->disableController();
 #endif
   writeSettings();
+  MoleculeCache::instance().setThreadPool(nullptr);
   delete m_molecule;
   delete m_menuBuilder;
+  delete m_pluginManifest;
   delete m_viewFactory;
 }
 
@@ -383,6 +511,8 @@ void MainWindow::setupInterface()
 
   m_multiViewWidget->addWidget(glWidget);
   ActiveObjects::instance().setActiveGLWidget(glWidget);
+  connect(glWidget, &QOpenGLWidget::frameSwapped, this,
+          &MainWindow::firstFrameSwapped);
 
   // set solid pipeline parameters
   Rendering::SolidPipeline* pipeline = &glWidget->renderer().solidPipeline();
@@ -479,7 +609,54 @@ void MainWindow::setupInterface()
   connect(m_moleculeTreeView, &QAbstractItemView::clicked, this,
           &MainWindow::moleculeActivated);
 
+  // The layer dock is tabbed behind the molecule dock, its view is set up
+  // after the window is shown.
   m_layerModel = new QtGui::LayerModel(this);
+  m_idleTasks->post("layer view", [this]() { setupLayerView(); });
+  m_idleTasks->post("menu icons", [this]() { loadDeferredIcons(); });
+  connect(m_sceneTreeView, &QAbstractItemView::clicked, m_layerModel,
+          &QtGui::LayerModel::updateRows);
+
+  // The first view uses the toolbar tools, build them before it.
+  StartupProfiler::instance().begin("buildTools");
+  buildTools();
+  StartupProfiler::instance().end("buildTools");
+  viewActivated(glWidget);
+  // Connect to the invalid context signal, check whether GL is initialized.
+  // connect(m_glWidget, SIGNAL(rendererInvalid()), SLOT(rendererInvalid()));
+  connect(m_multiViewWidget, &QtGui::MultiViewWidget::activeWidgetChanged, this,
+          &MainWindow::viewActivated);
+}
+
+void MainWindow::firstFrameSwapped()
+{
+  auto* glWidget = qobject_cast<QOpenGLWidget*>(sender());
+  if (glWidget) {
+    disconnect(glWidget, &QOpenGLWidget::frameSwapped, this,
+               &MainWindow::firstFrameSwapped);
+  }
+
+  // With files to open, start up ends when the first one is shown.
+  StartupProfiler::instance().mark("first frame");
+
+  // Work that is not needed to show the window is done from here on.
+  m_idleTasks->start();
+  finishStartup();
+
+  // check for version update, once the window is usable
+  QTimer::singleShot(0, this, &MainWindow::checkUpdate);
+}
+
+void MainWindow::finishStartup()
+{
+  if (m_idleTasks->isEmpty() && m_queuedFiles.isEmpty() &&
+      m_fileJobs->count(FileJobQueue::Read) == 0) {
+    StartupProfiler::instance().finish();
+  }
+}
+
+void MainWindow::setupLayerView()
+{
   m_layerTreeView->setModel(m_layerModel);
   m_layerTreeView->setSelectionBehavior(QAbstractItemView::SelectRows);
   m_layerTreeView->setAlternatingRowColors(true);
@@ -494,21 +671,35 @@ void MainWindow::setupInterface()
           &MainWindow::layerActivated);
   connect(m_layerTreeView, &QAbstractItemView::clicked, this,
           &MainWindow::layerActivated);
-  connect(m_sceneTreeView, &QAbstractItemView::clicked, m_layerModel,
-          &QtGui::LayerModel::updateRows);
+}
 
-  viewActivated(glWidget);
-  buildTools();
-  // Connect to the invalid context signal, check whether GL is initialized.
-  // connect(m_glWidget, SIGNAL(rendererInvalid()), SLOT(rendererInvalid()));
-  connect(m_multiViewWidget, &QtGui::MultiViewWidget::activeWidgetChanged, this,
-          &MainWindow::viewActivated);
+void MainWindow::deferIcon(QAction* action, const QString& iconName)
+{
+  m_deferredIcons.append(qMakePair(QPointer<QAction>(action), iconName));
+}
+
+void MainWindow::loadDeferredIcons()
+{
+  typedef QPair<QPointer<QAction>, QString> DeferredIcon;
+  foreach (const DeferredIcon& icon, m_deferredIcons) {
+    if (icon.first)
+      icon.first->setIcon(QIcon::fromTheme(icon.second));
+  }
+  m_deferredIcons.clear();
 }
 
 void MainWindow::closeEvent(QCloseEvent* e)
 {
   writeSettings();
-  if (!saveFileIfNeeded()) {
+  if (!saveFileIfNeeded([this]() { close(); })) {
+    e->ignore();
+    return;
+  }
+
+  // Closing would cancel the writes still running, close once they are done.
+  if (m_fileJobs->count(FileJobQueue::Write) > 0) {
+    m_closeAfterSave = true;
+    statusBar()->showMessage(tr("Closing once the files are saved…"));
     e->ignore();
     return;
   }
@@ -536,10 +727,11 @@ void MainWindow::dropEvent(QDropEvent* event)
         if (extension == "py")
           addScript(fileName);
         else
-          openFile(fileName);
+          m_queuedFiles << fileName;
       }
     }
     event->acceptProposedAction();
+    readQueuedFiles();
   } else
     event->ignore();
 }
@@ -626,6 +818,11 @@ void MainWindow::setMolecule(Molecule* mol)
 
   emit moleculeChanged(m_molecule);
   markMoleculeClean();
+  // A recovered copy holds changes that were never saved.
+  if (m_molecule->property("recovered").toBool()) {
+    m_molecule->setProperty("recovered", QVariant());
+    markMoleculeDirty();
+  }
   updateWindowTitle();
   m_moleculeModel->setActiveMolecule(m_molecule);
   m_layerModel->addMolecule(m_molecule);
@@ -655,7 +852,11 @@ void MainWindow::setMolecule(Molecule* mol)
 
 void MainWindow::markMoleculeDirty()
 {
+  if (m_readingChanges)
+    return;
+  ++m_editGeneration;
   activeMoleculeEdited();
+  m_autoSaver->moleculeChanged(m_molecule);
   if (!m_moleculeDirty) {
     m_moleculeDirty = true;
     updateWindowTitle();
@@ -758,32 +959,53 @@ void MainWindow::readSettings()
   move(settings.value("pos", QPoint(20, 20)).toPoint());
   settings.endGroup();
   m_recentFiles = settings.value("recentFiles", QStringList()).toStringList();
+  // Opt in, mostly helps multi gigabyte trajectories and volumetric data.
+  BackgroundFileFormat::setMemoryMapping(
+    settings.value("io/memoryMappedReads", false).toBool());
+  BackgroundFileFormat::setDeferredCubes(
+    settings.value("io/deferredCubes", true).toBool());
+  // Slow reads are kept in the cache, the size is in MiB.
+  MoleculeCache& cache = MoleculeCache::instance();
+  cache.setEnabled(settings.value("io/moleculeCache", true).toBool());
+  cache.setMaximumSize(
+    settings.value("io/moleculeCacheSize", 1024).toLongLong() << 20);
 }
 
 void MainWindow::openFile()
 {
-  if (!saveFileIfNeeded())
+  if (!saveFileIfNeeded([this]() { openFile(); }))
     return;
 
-  QString filter(QString("%1 (*.cml);;%2 (*.cjson)")
+  QString filter(QString("%1 (*.cml);;%2 (*.cjson);;%3 (*.gz *.zst *.xz)")
                    .arg(tr("Chemical Markup Language"))
-                   .arg(tr("Chemical JSON")));
+                   .arg(tr("Chemical JSON"))
+                   .arg(tr("Compressed files")));
 
   QSettings settings;
   QString dir = settings.value("MainWindow/lastOpenDir").toString();
 
-  QString fileName =
-    QFileDialog::getOpenFileName(this, tr("Open chemical file"), dir, filter);
+  QStringList fileNames =
+    QFileDialog::getOpenFileNames(this, tr("Open chemical file"), dir, filter);
 
-  if (fileName.isEmpty()) // user cancel
+  if (fileNames.isEmpty()) // user cancel
     return;
 
+  if (fileNames.size() > 1) {
+    settings.setValue("MainWindow/lastOpenDir",
+                      QFileInfo(fileNames.first()).absolutePath());
+    m_queuedFiles << fileNames;
+    readQueuedFiles();
+    return;
+  }
+
+  QString fileName = fileNames.first();
   QFileInfo info(fileName);
   dir = info.absoluteDir().absolutePath();
   settings.setValue("MainWindow/lastOpenDir", dir);
 
   // Create one of our readers to read the file:
-  QString extension = info.suffix().toLower();
+  QString extension =
+    QFileInfo(CompressedStreamBuf::baseFileName(fileName)).suffix().toLower();
   FileFormat* reader = nullptr;
   if (extension == "cml")
     reader = new Io::CmlFormat;
@@ -798,7 +1020,7 @@ void MainWindow::openFile()
 
 void MainWindow::importFile()
 {
-  if (!saveFileIfNeeded())
+  if (!saveFileIfNeeded([this]() { importFile(); }))
     return;
 
   QSettings settings;
@@ -889,7 +1111,8 @@ bool MainWindow::openFile(const QString& fileName, Io::FileFormat* reader)
 
   if (reader == nullptr) {
     const Io::FileFormat* format = QtGui::FileFormatDialog::findFileFormat(
-      this, tr("Select file reader"), fileName,
+      this, tr("Select file reader"),
+      CompressedStreamBuf::baseFileName(fileName),
       FileFormat::File | FileFormat::Read, "Avogadro:");
     if (format)
       reader = format->newInstance();
@@ -899,87 +1122,191 @@ bool MainWindow::openFile(const QString& fileName, Io::FileFormat* reader)
 
   QString ident = QString::fromStdString(reader->identifier());
 
-  // Prepare the background thread to read in the selected file.
-  if (!m_fileReadThread)
-    m_fileReadThread = new QThread(this);
-  if (m_threadedReader)
-    m_threadedReader->deleteLater();
-  m_threadedReader = new BackgroundFileFormat(reader);
-  if (m_fileReadMolecule)
-    m_fileReadMolecule->deleteLater();
-  m_fileReadMolecule = new Molecule(this);
-  m_fileReadMolecule->setData("fileName", qPrintable(fileName));
-  m_threadedReader->moveToThread(m_fileReadThread);
-  m_threadedReader->setMolecule(m_fileReadMolecule);
-  m_threadedReader->setFileName(fileName);
+  // Queue the read on the I/O workers.
+  auto* molecule = new Molecule(this);
+  molecule->setData("fileName", qPrintable(fileName));
+  int id = m_fileJobs->read(fileName, reader, molecule);
 
   // Setup a progress dialog in case file loading is slow
-  m_progressDialog = new QProgressDialog(this);
-  m_progressDialog->setRange(0, 0);
-  m_progressDialog->setValue(0);
-  m_progressDialog->setMinimumDuration(750);
-  m_progressDialog->setWindowTitle(tr("Reading File"));
-  m_progressDialog->setLabelText(
-    tr("Opening file '%1'\nwith '%2'").arg(fileName).arg(ident));
-  /// @todo Add API to abort file ops
-  m_progressDialog->setCancelButton(nullptr);
-  connect(m_fileReadThread, &QThread::started, m_threadedReader,
-          &BackgroundFileFormat::read);
-  connect(m_threadedReader, &BackgroundFileFormat::finished, m_fileReadThread,
-          &QThread::quit);
-  connect(m_threadedReader, &BackgroundFileFormat::finished, this,
-          &MainWindow::backgroundReaderFinished);
-
-  // Start the file operation
-  m_fileReadThread->start();
-  m_progressDialog->show();
+  showFileProgress(id, tr("Reading File"),
+                   tr("Opening file '%1'\nwith '%2'").arg(fileName).arg(ident));
 
   return true;
 }
 
-void MainWindow::backgroundReaderFinished()
+void MainWindow::fileJobFinished(int id)
 {
-  QString fileName = m_threadedReader->fileName();
-  if (m_progressDialog->wasCanceled()) {
-    delete m_fileReadMolecule;
-  } else if (m_threadedReader->success()) {
-    if (!fileName.isEmpty()) {
-      m_fileReadMolecule->setData("fileName", qPrintable(fileName));
-      m_recentFiles.prepend(fileName);
-      updateRecentFiles();
-    } else {
-      m_fileReadMolecule->setData("fileName", Core::Variant());
-    }
+  if (m_fileJobs->operation(id) == FileJobQueue::Read)
+    backgroundReaderFinished(id);
+  else
+    backgroundWriterFinished(id);
+}
 
-    setMolecule(m_fileReadMolecule);
+void MainWindow::fileJobFirstFrame(int id)
+{
+  // Queued files are made active together once all are read.
+  if (m_batchJobs.contains(id))
+    return;
+
+  BackgroundFileFormat* reader = m_fileJobs->job(id);
+  auto* molecule = static_cast<Molecule*>(reader->molecule());
+  closeFileProgress(id);
+
+  QString fileName = reader->fileName();
+  setReadFileName(molecule, fileName);
+  updateRecentFiles();
+  setMolecule(molecule);
+  moleculeShown();
+  restoreCamera(molecule);
+  reassignCustomElements();
 
-    // check if the modelView is set
-    if (m_fileReadMolecule->hasData("modelView")) {
-      MatrixX m = m_fileReadMolecule->data("modelView").value<MatrixX>();
-      // convert to an Affine3f for the camera
-      Eigen::Affine3f a;
-      a.matrix() = m.cast<float>();
+  // The molecule can be used while the remaining frames are read, show their
+  // progress in the status bar rather than in a dialog.
+  auto* progress = new QWidget(statusBar());
+  auto* layout = new QHBoxLayout(progress);
+  layout->setContentsMargins(0, 0, 0, 0);
+  auto* bar = new QProgressBar(progress);
+  auto* stop = new QToolButton(progress);
+  if (reader->cubes()) {
+    // No signals while the grids are read, poll the bytes read.
+    bar->setFormat(tr("Volumetric data %p%"));
+    stop->setToolTip(tr("Stop reading volumetric data"));
+    auto* timer = new QTimer(progress);
+    connect(timer, &QTimer::timeout, this, [this, id]() { fileJobFrames(id); });
+    timer->start(200);
+  } else {
+    bar->setFormat(tr("%v of about %m frames"));
+    stop->setToolTip(tr("Stop reading frames"));
+  }
+  stop->setIcon(QIcon::fromTheme("process-stop"));
+  stop->setAutoRaise(true);
+  connect(stop, &QToolButton::clicked, m_fileJobs,
+          [this, id]() { m_fileJobs->cancel(id); });
+  layout->addWidget(bar);
+  layout->addWidget(stop);
+  statusBar()->addPermanentWidget(progress);
+  m_frameProgress.insert(id, bar);
+  m_frameMolecules.insert(id, molecule);
+  // The remaining frames are of no use once the molecule is closed.
+  connect(molecule, &QObject::destroyed, m_fileJobs,
+          [this, id]() { m_fileJobs->cancel(id); });
+  fileJobFrames(id);
+}
+
+void MainWindow::fileJobFrames(int id)
+{
+  // Batch reads keep their frames until the molecule is added.
+  QProgressBar* bar = m_frameProgress.value(id);
+  BackgroundFileFormat* reader = m_fileJobs->job(id);
+  if (!bar || !reader)
+    return;
+
+  if (reader->cubes()) {
+    qint64 total = qMax<qint64>(1, reader->bytesTotal());
+    bar->setMaximum(100);
+    bar->setValue(static_cast<int>(100 * reader->bytesProcessed() / total));
+    return;
+  }
 
-      if (auto* glWidget = qobject_cast<QtOpenGL::GLWidget*>(
-            m_multiViewWidget->activeWidget())) {
-        glWidget->renderer().camera().setModelView(a);
-        glWidget->requestUpdate();
+  Molecule* molecule = m_frameMolecules.value(id);
+  if (!molecule)
+    return;
+  if (appendFrames(molecule, reader->takeFrames()))
+    emitReadChanges(molecule, Molecule::Atoms | Molecule::Modified);
+  bar->setMaximum(reader->estimatedFrameCount());
+  bar->setValue(reader->frameCount());
+}
+
+void MainWindow::backgroundReaderFinished(int id)
+{
+  BackgroundFileFormat* reader = m_fileJobs->job(id);
+  auto* molecule = static_cast<Molecule*>(reader->molecule());
+  closeFileProgress(id);
+
+  QString fileName = reader->fileName();
+  if (m_frameProgress.contains(id)) {
+    // Shown since the first frame, add the last frames.
+    fileJobFrames(id);
+    QProgressBar* bar = m_frameProgress.take(id);
+    statusBar()->removeWidget(bar->parentWidget());
+    bar->parentWidget()->deleteLater();
+    Molecule* shown = m_frameMolecules.take(id);
+
+    int frames = reader->frameCount();
+    if (reader->cubes()) {
+      if (reader->success() && shown && appendCubes(shown, reader->cubes()))
+        emitReadChanges(shown, Molecule::Added);
+      if (reader->success()) {
+        statusBar()->showMessage(tr("Read the volumetric data"), 5000);
+      } else if (reader->isCanceled()) {
+        statusBar()->showMessage(tr("Volumetric data not read"), 5000);
+      } else {
+        MESSAGEBOX::warning(this, tr("File error"),
+                            tr("Error while reading the volumetric data of "
+                               "'%1':\n%2")
+                              .arg(fileName)
+                              .arg(reader->error()));
       }
+    } else if (reader->success()) {
+      // Unless edited while the frames were read.
+      if (shown && shown->undoMolecule()->undoStack().count() == 0)
+        reader->cacheFrames(*shown);
+      statusBar()->showMessage(tr("Read %n frame(s)", "", frames), 5000);
+    } else if (reader->isCanceled()) {
+      statusBar()->showMessage(tr("Stopped after %n frame(s)", "", frames),
+                               5000);
+    } else {
+      MESSAGEBOX::warning(
+        this, tr("File error"),
+        tr("Reading '%1' stopped after %n frame(s):\n%2", "", frames)
+          .arg(fileName)
+          .arg(reader->error()));
     }
-    // and the projection matrix
-    if (m_fileReadMolecule->hasData("projection")) {
-      MatrixX m = m_fileReadMolecule->data("projection").value<MatrixX>();
-      // convert to an Affine3f for the camera
-      Eigen::Affine3f a;
-      a.matrix() = m.cast<float>();
-
-      if (auto* glWidget = qobject_cast<QtOpenGL::GLWidget*>(
-            m_multiViewWidget->activeWidget())) {
-        glWidget->renderer().camera().setProjection(a);
-        glWidget->requestUpdate();
-      }
+    readQueuedFiles();
+    finishStartup();
+    return;
+  }
+
+  if (m_batchJobs.remove(id)) {
+    // Part of several files read together: add it to the model, only the
+    // last one is made active once all are done.
+    ++m_batchDone;
+    if (reader->success() && !reader->isCanceled()) {
+      setReadFileName(molecule, fileName);
+      appendFrames(molecule, reader->takeFrames());
+      reader->cacheFrames(*molecule);
+      appendCubes(molecule, reader->cubes());
+      m_moleculeModel->addItem(molecule);
+      m_batchMolecule = molecule;
+    } else {
+      if (!reader->isCanceled())
+        m_batchErrors << tr("%1: %2", "%1 = file name, %2 = error message")
+                           .arg(fileName)
+                           .arg(reader->error());
+      delete molecule;
+    }
+    // Start the next file, and finish up if this was the last.
+    readQueuedFiles();
+    return;
+  }
+
+  if (reader->isCanceled()) {
+    // Free the partially read molecule.
+    delete molecule;
+    statusBar()->showMessage(tr("Reading %1 canceled").arg(fileName), 5000);
+  } else if (reader->success()) {
+    if (!fileName.isEmpty()) {
+      setReadFileName(molecule, fileName);
+      updateRecentFiles();
+    } else {
+      molecule->setData("fileName", Core::Variant());
     }
 
+    setMolecule(molecule);
+
+    moleculeShown();
+    restoreCamera(molecule);
+
     statusBar()->showMessage(tr("Molecule loaded (%1 atoms, %2 bonds)")
                                .arg(m_molecule->atomCount())
                                .arg(m_molecule->bondCount()),
@@ -988,34 +1315,157 @@ void MainWindow::backgroundReaderFinished()
     MESSAGEBOX::critical(this, tr("File error"),
                          tr("Error while reading file '%1':\n%2")
                            .arg(fileName)
-                           .arg(m_threadedReader->error()));
-    delete m_fileReadMolecule;
-  }
-  m_fileReadThread->deleteLater();
-  m_fileReadThread = nullptr;
-  m_threadedReader->deleteLater();
-  m_threadedReader = nullptr;
-  m_fileReadMolecule = nullptr;
-  m_progressDialog->hide();
-  m_progressDialog->deleteLater();
-  m_progressDialog = nullptr;
-
+                           .arg(reader->error()));
+    delete molecule;
+  }
   reassignCustomElements();
 
-  if (!m_queuedFiles.empty())
-    readQueuedFiles();
+  readQueuedFiles();
+  finishStartup();
 }
 
-bool MainWindow::backgroundWriterFinished()
+void MainWindow::moleculeShown()
 {
-  QString fileName = m_threadedWriter->fileName();
+  if (!m_readiness->moleculeLoaded())
+    return;
+
+  qCDebug(lcStartup) << "Time to first molecule:"
+                     << m_readiness->timeToFirstMolecule() << "ms";
+  StartupProfiler::instance().mark("first molecule");
+}
+
+void MainWindow::restoreCamera(Molecule* molecule)
+{
+  // check if the modelView is set
+  if (molecule->hasData("modelView")) {
+    MatrixX m = molecule->data("modelView").value<MatrixX>();
+    // convert to an Affine3f for the camera
+    Eigen::Affine3f a;
+    a.matrix() = m.cast<float>();
+
+    if (auto* glWidget = qobject_cast<QtOpenGL::GLWidget*>(
+          m_multiViewWidget->activeWidget())) {
+      glWidget->renderer().camera().setModelView(a);
+      glWidget->requestUpdate();
+    }
+  }
+  // and the projection matrix
+  if (molecule->hasData("projection")) {
+    MatrixX m = molecule->data("projection").value<MatrixX>();
+    // convert to an Affine3f for the camera
+    Eigen::Affine3f a;
+    a.matrix() = m.cast<float>();
+
+    if (auto* glWidget = qobject_cast<QtOpenGL::GLWidget*>(
+          m_multiViewWidget->activeWidget())) {
+      glWidget->renderer().camera().setProjection(a);
+      glWidget->requestUpdate();
+    }
+  }
+}
+
+void MainWindow::showFileProgress(int id, const QString& title,
+                                  const QString& label)
+{
+  auto* progressDialog = new QProgressDialog(this);
+  progressDialog->setRange(0, 0);
+  progressDialog->setValue(0);
+  progressDialog->setMinimumDuration(750);
+  progressDialog->setWindowTitle(title);
+  progressDialog->setLabelText(label);
+  // Only this job is canceled, other reads and writes carry on.
+  connect(progressDialog, &QProgressDialog::canceled, m_fileJobs,
+          [this, id]() { m_fileJobs->cancel(id); });
+  m_jobDialogs.insert(id, progressDialog);
+  progressDialog->show();
+  trackFileProgress(progressDialog, m_fileJobs->job(id));
+}
+
+void MainWindow::closeFileProgress(int id)
+{
+  QProgressDialog* progressDialog = m_jobDialogs.take(id);
+  if (progressDialog) {
+    progressDialog->hide();
+    progressDialog->deleteLater();
+  }
+}
+
+void MainWindow::trackFileProgress(QProgressDialog* progressDialog,
+                                   BackgroundFileFormat* fileFormat)
+{
+  // The worker only updates atomic counters, poll them from here.
+  QPointer<BackgroundFileFormat> format(fileFormat);
+  QPointer<QProgressDialog> dialog(progressDialog);
+  const QString label = progressDialog->labelText();
+  progressDialog->setAutoReset(false);
+  progressDialog->setAutoClose(false);
+  QElapsedTimer elapsed;
+  elapsed.start();
+
+  auto* timer = new QTimer(progressDialog);
+  connect(timer, &QTimer::timeout, progressDialog, [=]() {
+    if (!format || !dialog || !dialog->isVisible())
+      return;
+    qint64 done = format->bytesProcessed();
+    qint64 total = format->bytesTotal();
+    double seconds = elapsed.elapsed() / 1000.0;
+    if (done <= 0 || seconds <= 0.0)
+      return;
+
+    QLocale locale;
+    double rate = done / seconds;
+    QString status;
+    if (total > 0) {
+      dialog->setRange(0, 1000);
+      dialog->setValue(static_cast<int>(qMin(done, total) * 1000 / total));
+      status = tr("%1 of %2 (%3/s)", "%1 = bytes read, %2 = size, %3 = rate")
+                 .arg(locale.formattedDataSize(done))
+                 .arg(locale.formattedDataSize(total))
+                 .arg(locale.formattedDataSize(static_cast<qint64>(rate)));
+      if (done < total) {
+        int remaining = qCeil((total - done) / rate);
+        status += '\n' + tr("About %n second(s) remaining", "", remaining);
+      }
+    } else {
+      status = tr("%1 (%2/s)", "%1 = bytes written, %2 = rate")
+                 .arg(locale.formattedDataSize(done))
+                 .arg(locale.formattedDataSize(static_cast<qint64>(rate)));
+    }
+    dialog->setLabelText(label + '\n' + status);
+  });
+  timer->start(100);
+}
+
+bool MainWindow::backgroundWriterFinished(int id)
+{
+  BackgroundFileFormat* writer = m_fileJobs->job(id);
+  SaveJob save = m_saveJobs.take(id);
+  closeFileProgress(id);
+  bool success = saveFinished(writer, save);
+
+  // The snapshot taken by saveFileAs().
+  delete writer->molecule();
+  return success;
+}
+
+bool MainWindow::saveFinished(BackgroundFileFormat* writer,
+                              const SaveJob& save)
+{
+  QString fileName = writer->fileName();
   bool success = false;
-  if (!m_progressDialog->wasCanceled()) {
-    if (m_threadedWriter->success()) {
+  if (writer->isCanceled()) {
+    statusBar()->showMessage(tr("Saving %1 canceled").arg(fileName), 5000);
+  } else {
+    if (writer->success()) {
       statusBar()->showMessage(
         tr("Saved file %1", "%1 = filename").arg(fileName));
-      m_threadedWriter->molecule()->setData("fileName", qPrintable(fileName));
-      markMoleculeClean();
+      if (save.molecule)
+        save.molecule->setData("fileName", qPrintable(fileName));
+      // Edits made while writing are not in the file.
+      if (save.molecule == m_molecule && save.generation == m_editGeneration) {
+        markMoleculeClean();
+        m_autoSaver->discard(save.molecule);
+      }
       updateWindowTitle();
       success = true;
     } else {
@@ -1023,15 +1473,16 @@ bool MainWindow::backgroundWriterFinished()
         this, tr("Error saving file"),
         tr("Error while saving '%1':\n%2", "%1 = file name, %2 = error message")
           .arg(fileName)
-          .arg(m_threadedWriter->error()));
+          .arg(writer->error()));
     }
   }
-  m_fileWriteThread->deleteLater();
-  m_fileWriteThread = nullptr;
-  m_threadedWriter->deleteLater();
-  m_threadedWriter = nullptr;
-  m_progressDialog->deleteLater();
-  m_progressDialog = nullptr;
+
+  if (success && save.then)
+    QTimer::singleShot(0, this, save.then);
+  if (m_closeAfterSave && m_fileJobs->count(FileJobQueue::Write) == 0) {
+    m_closeAfterSave = false;
+    QTimer::singleShot(0, this, &QWidget::close);
+  }
   return success;
 }
 
@@ -1040,7 +1491,8 @@ void MainWindow::toolActivated()
   if (auto* action = qobject_cast<QAction*>(sender())) {
     if (auto* glWidget =
           qobject_cast<GLWidget*>(m_multiViewWidget->activeWidget())) {
-      glWidget->setActiveTool(action->data().toString());
+      if (ToolPlugin* tool = viewTool(glWidget, action->data().toString()))
+        glWidget->setActiveTool(tool);
       if (glWidget->activeTool()) {
         m_toolDock->setWidget(glWidget->activeTool()->toolWidget());
         m_toolDock->setWindowTitle(action->text());
@@ -1055,6 +1507,20 @@ void MainWindow::toolActivated()
   }
 }
 
+ToolPlugin* MainWindow::viewTool(GLWidget* glWidget, const QString& name)
+{
+  foreach (ToolPlugin* tool, glWidget->tools()) {
+    if (tool->objectName() == name)
+      return tool;
+  }
+
+  ToolPluginFactory* factory = m_toolFactories.value(name);
+  ToolPlugin* tool = factory ? factory->createInstance(glWidget) : nullptr;
+  if (tool)
+    glWidget->addTool(tool);
+  return tool;
+}
+
 void MainWindow::viewConfigActivated() {}
 
 void MainWindow::rendererInvalid()
@@ -1140,6 +1606,171 @@ void MainWindow::moleculeActivated(const QModelIndex& idx)
   }
 }
 
+void MainWindow::openLibrary()
+{
+  QSettings settings;
+  QString dir = settings.value("MainWindow/lastOpenDir").toString();
+  QString filter = tr("Structure libraries (*.sdf *.sd *.pdb *.ent *.xyz)");
+  QString fileName =
+    QFileDialog::getOpenFileName(this, tr("Open Library"), dir, filter);
+  if (fileName.isEmpty()) // user cancel
+    return;
+
+  settings.setValue("MainWindow/lastOpenDir",
+                    QFileInfo(fileName).absolutePath());
+  const Io::FileFormat* format = QtGui::FileFormatDialog::findFileFormat(
+    this, tr("Select file reader"), fileName,
+    FileFormat::File | FileFormat::Read | FileFormat::String, "Avogadro:");
+  if (!format || !openLibrary(fileName, format->newInstance())) {
+    MESSAGEBOX::warning(this, tr("Cannot open file"),
+                        tr("Can't open supplied file %1").arg(fileName));
+  }
+}
+
+bool MainWindow::openLibrary(const QString& fileName, Io::FileFormat* reader)
+{
+  showLibrary();
+  int firstRow = m_library->rowCount();
+  if (!m_library->addFile(fileName, reader))
+    return false;
+
+  m_libraryFirstRow = firstRow;
+  m_recentFiles.prepend(fileName);
+  updateRecentFiles();
+  statusBar()->showMessage(tr("Indexing %1…").arg(fileName));
+  return true;
+}
+
+void MainWindow::openFolder()
+{
+  QSettings settings;
+  QString dir = settings.value("MainWindow/lastOpenDir").toString();
+  dir = QFileDialog::getExistingDirectory(this, tr("Open Folder"), dir);
+  if (dir.isEmpty()) // user cancel
+    return;
+
+  settings.setValue("MainWindow/lastOpenDir", dir);
+  showLibrary();
+  m_libraryFirstRow = m_library->rowCount();
+  m_library->addFolder(dir);
+  statusBar()->showMessage(tr("Indexing %1…").arg(dir));
+}
+
+void MainWindow::showLibrary()
+{
+  if (!m_libraryDock) {
+    m_library = new LibraryModel(this);
+    QSettings settings;
+    m_library->setCacheSize(settings.value("library/cacheSize", 64).toInt());
+    if (settings.contains("library/indexThreads")) {
+      m_library->setIndexThreadCount(
+        settings.value("library/indexThreads").toInt());
+    }
+    connect(m_library, &LibraryModel::indexed, this,
+            [this](const QString& fileName, int records) {
+              statusBar()->showMessage(
+                tr("%n structure(s) in %1", "", records).arg(fileName), 5000);
+            });
+    // Show the first record of a file as soon as it is found.
+    connect(m_library, &QAbstractItemModel::rowsInserted, this,
+            [this](const QModelIndex&, int, int last) {
+              if (m_libraryFirstRow >= 0 && last >= m_libraryFirstRow) {
+                m_libraryView->setCurrentIndex(
+                  m_library->index(m_libraryFirstRow, 0));
+                m_libraryFirstRow = -1;
+              }
+            });
+    connect(m_library, &LibraryModel::moleculeRead, this,
+            [this](int row, const QString& error) {
+              if (row != m_libraryReadRow)
+                return;
+              m_libraryReadRow = -1;
+              QModelIndex index = m_library->index(row, 0);
+              if (!error.isEmpty()) {
+                statusBar()->showMessage(tr("Cannot read %1: %2")
+                                           .arg(index.data().toString())
+                                           .arg(error),
+                                         5000);
+              } else {
+                statusBar()->clearMessage();
+                libraryActivated(index);
+              }
+            });
+
+    m_libraryDock = new QDockWidget(tr("Library"), this);
+    m_libraryView = new QTreeView(m_libraryDock);
+    // Uniform rows keep large libraries fast, only visible rows are laid out.
+    m_libraryView->setUniformRowHeights(true);
+    m_libraryView->setRootIsDecorated(false);
+    m_libraryView->setAlternatingRowColors(true);
+    m_libraryView->setSelectionBehavior(QAbstractItemView::SelectRows);
+    m_libraryView->setSelectionMode(QAbstractItemView::SingleSelection);
+    m_libraryView->setModel(m_library);
+    m_libraryView->header()->setStretchLastSection(false);
+    m_libraryView->header()->setSectionResizeMode(LibraryModel::NameColumn,
+                                                  QHeaderView::Stretch);
+    for (int i = 1; i < LibraryModel::ColumnCount; ++i) {
+      m_libraryView->header()->setSectionResizeMode(i,
+                                                    QHeaderView::Interactive);
+      m_libraryView->header()->resizeSection(
+        i, i == LibraryModel::FormulaColumn ? 100 : 60);
+    }
+    // Browsing with the keyboard shows each record in turn.
+    connect(m_libraryView->selectionModel(),
+            &QItemSelectionModel::currentRowChanged, this,
+            &MainWindow::libraryActivated);
+    m_libraryDock->setWidget(m_libraryView);
+    addDockWidget(Qt::LeftDockWidgetArea, m_libraryDock);
+    tabifyDockWidget(m_moleculeDock, m_libraryDock);
+  }
+  m_libraryDock->show();
+  m_libraryDock->raise();
+}
+
+void MainWindow::libraryActivated(const QModelIndex& index)
+{
+  if (!index.isValid())
+    return;
+
+  // A record activated later replaces one still being read.
+  m_libraryReadRow = -1;
+  const Core::Molecule* parsed = m_library->molecule(index.row());
+  if (!parsed && m_library->error().isEmpty()) {
+    m_libraryReadRow = index.row();
+    statusBar()->showMessage(tr("Reading %1…").arg(index.data().toString()));
+    return;
+  }
+  if (!parsed) {
+    statusBar()->showMessage(tr("Cannot read %1: %2")
+                               .arg(index.data().toString())
+                               .arg(m_library->error()),
+                             5000);
+    return;
+  }
+
+  // The molecule showing the previous record is reused unless it was edited,
+  // so memory does not grow with the number of records viewed.
+  if (m_libraryMolecule && m_libraryMolecule == m_molecule &&
+      !m_moleculeDirty) {
+    *m_libraryMolecule = *parsed;
+    m_libraryMolecule->emitChanged(Molecule::Atoms | Molecule::Bonds |
+                                   Molecule::Added | Molecule::Removed);
+    markMoleculeClean();
+    m_autoSaver->discard(m_libraryMolecule);
+    if (auto* glWidget =
+          qobject_cast<GLWidget*>(m_multiViewWidget->activeWidget())) {
+      glWidget->resetCamera();
+    }
+  } else {
+    // Not saved to the library file, which holds the other records.
+    auto* molecule = new Molecule(this);
+    *molecule = *parsed;
+    setMolecule(molecule);
+    m_libraryMolecule = molecule;
+  }
+  updateWindowTitle();
+}
+
 void MainWindow::sceneItemActivated(const QModelIndex& idx)
 {
   if (!idx.isValid())
@@ -1177,21 +1808,13 @@ bool populatePluginModel(ScenePluginModel& model, QObject* p,
 }
 
 template<class T>
-bool populateTools(T* glWidget)
+void populateTools(T* glWidget, const QList<ToolPlugin*>& tools)
 {
-  if (!glWidget->tools().isEmpty())
-    return false;
-  PluginManager* plugin = PluginManager::instance();
-  QList<ToolPluginFactory*> toolPluginFactories =
-    plugin->pluginFactories<ToolPluginFactory>();
-  foreach (ToolPluginFactory* factory, toolPluginFactories) {
-    ToolPlugin* tool = factory->createInstance(QCoreApplication::instance());
-    if (tool)
-      glWidget->addTool(tool);
-  }
+  // addTool() binds the tool to this view only, its updates redraw this view.
+  foreach (ToolPlugin* tool, tools)
+    glWidget->addTool(tool);
   glWidget->setDefaultTool("Navigator");
   glWidget->setActiveTool("Navigator");
-  return true;
 }
 
 void MainWindow::viewActivated(QWidget* widget)
@@ -1205,7 +1828,23 @@ void MainWindow::viewActivated(QWidget* widget)
     m_sceneTreeView->header()->resizeSection(1, 40);
     m_sceneTreeView->header()->setSectionResizeMode(0, QHeaderView::Stretch);
 
-    populateTools(glWidget);
+    // Tools keep state such as picks and selections, each view has its own
+    // instances. The first view takes those built for the toolbar, so a
+    // single view does not construct the tools twice. Later views start with
+    // the navigator, viewTool() adds the others once they are picked.
+    if (glWidget->tools().isEmpty()) {
+      if (!m_toolbarToolsUsed) {
+        populateTools(glWidget, m_tools);
+        // addTool() reparents the tools to the view, the toolbar still needs
+        // them once the view is closed.
+        foreach (ToolPlugin* tool, m_tools)
+          tool->setParent(this);
+        m_toolbarToolsUsed = true;
+      } else if (viewTool(glWidget, "Navigator")) {
+        glWidget->setDefaultTool("Navigator");
+        glWidget->setActiveTool("Navigator");
+      }
+    }
 
     foreach (ExtensionPlugin* extension, m_extensions) {
       extension->setScene(&glWidget->renderer().scene());
@@ -1222,6 +1861,8 @@ void MainWindow::viewActivated(QWidget* widget)
       // Figure out the active tool - reflect this in the toolbar.
       ToolPlugin* tool = glWidget->activeTool();
       if (tool) {
+        m_toolDock->setWidget(tool->toolWidget());
+        m_toolDock->setWindowTitle(tool->activateAction()->text());
         QString name = tool->objectName();
         foreach (QAction* action, m_toolToolBar->actions()) {
           action->setChecked(action->data().toString() == name);
@@ -1364,22 +2005,24 @@ void MainWindow::reassignCustomElements()
 
 void MainWindow::openRecentFile()
 {
-  if (!saveFileIfNeeded())
-    return;
-
   auto* action = qobject_cast<QAction*>(sender());
-  if (action) {
-    QString fileName = action->data().toString();
+  if (!action)
+    return;
 
-    const FileFormat* format =
-      FileFormatDialog::findFileFormat(this, tr("Select file reader"), fileName,
-                                       FileFormat::File | FileFormat::Read);
+  QString fileName = action->data().toString();
+  auto open = [this, fileName]() {
+    const FileFormat* format = FileFormatDialog::findFileFormat(
+      this, tr("Select file reader"),
+      CompressedStreamBuf::baseFileName(fileName),
+      FileFormat::File | FileFormat::Read);
 
     if (!openFile(fileName, format ? format->newInstance() : nullptr)) {
       MESSAGEBOX::information(this, tr("Cannot open file"),
                               tr("Can't open supplied file %1").arg(fileName));
     }
-  }
+  };
+  if (saveFileIfNeeded(open))
+    open();
 }
 
 void MainWindow::updateRecentFiles()
@@ -1435,8 +2078,10 @@ bool MainWindow::saveFile(bool async)
     return saveFileAs(async);
 
   string fileName = mol->data("fileName").toString();
-  QString extension =
-    QFileInfo(QString::fromStdString(fileName)).suffix().toLower();
+  // A compressed file is saved compressed again.
+  QString baseName =
+    CompressedStreamBuf::baseFileName(QString::fromStdString(fileName));
+  QString extension = QFileInfo(baseName).suffix().toLower();
 
   if (extension.isEmpty()) {
     fileName += ".cjson";
@@ -1509,8 +2154,10 @@ bool MainWindow::saveFileAs(bool async)
   dir = info.absoluteDir().absolutePath();
   settings.setValue("MainWindow/lastSaveDir", dir);
 
-  // Use manually entered extension if present
-  QString extension = info.suffix().toLower();
+  // Use manually entered extension if present, "name.cjson.zst" is
+  // compressed CJSON.
+  QString extension =
+    QFileInfo(CompressedStreamBuf::baseFileName(fileName)).suffix().toLower();
   // Otherwise, get extension from selected filter
   if (extension.isEmpty()) {
     QString filter = saveDialog.selectedNameFilter();
@@ -1560,7 +2207,9 @@ bool MainWindow::exportFile(const QString& fileName, bool async)
 
   std::vector<const FileFormat*> writers =
     Io::FileFormatManager::instance().fileFormatsFromFileExtension(
-      QFileInfo(fileName).suffix().toStdString(),
+      QFileInfo(CompressedStreamBuf::baseFileName(fileName))
+        .suffix()
+        .toStdString(),
       FileFormat::File | FileFormat::Write);
 
   if (!writers.empty()) {
@@ -1599,13 +2248,6 @@ bool MainWindow::saveFileAs(const QString& fileName, Io::FileFormat* writer,
     return false;
   }
 
-  // Initialize out writer.
-  if (!m_fileWriteThread)
-    m_fileWriteThread = new QThread(this);
-  if (m_threadedWriter)
-    m_threadedWriter->deleteLater();
-  m_threadedWriter = new BackgroundFileFormat(writer);
-
   auto* mol = qobject_cast<Molecule*>(molObj);
   if (!mol) {
     delete writer;
@@ -1627,57 +2269,54 @@ bool MainWindow::saveFileAs(const QString& fileName, Io::FileFormat* writer,
     mol->setData("projection", projection);
   }
 
-  // Prepare the background thread to write the selected file.
-  m_threadedWriter->moveToThread(m_fileWriteThread);
-  m_threadedWriter->setMolecule(mol);
-  m_threadedWriter->setFileName(fileName);
+  SaveJob save;
+  save.molecule = mol;
+  save.generation = m_editGeneration;
+  save.then = m_afterSave;
+
+  if (!async) {
+    // The caller waits for the result, write on this thread. The molecule
+    // cannot change meanwhile, so it is written without a copy.
+    BackgroundFileFormat job(writer);
+    job.setFileName(fileName);
+    job.setMolecule(mol);
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    job.write();
+    QApplication::restoreOverrideCursor();
+    return saveFinished(&job, save);
+  }
+
+  // The writer gets a copy, so editing can go on while it is written. The
+  // copy is made here: the atom data arrays are shared until either side
+  // changes them, but the graph, cubes, meshes and basis set are copied.
+  QElapsedTimer timer;
+  timer.start();
+  auto* snapshot = new Core::Molecule(*mol);
+  qCDebug(lcSave) << "Copied" << mol->atomCount() << "atoms for saving in"
+                  << timer.elapsed() << "ms";
+  int id = m_fileJobs->write(fileName, writer, snapshot);
+  m_saveJobs.insert(id, save);
 
   // Setup a progress dialog in case file loading is slow
-  m_progressDialog = new QProgressDialog(this);
-  m_progressDialog->setRange(0, 0);
-  m_progressDialog->setValue(0);
-  m_progressDialog->setMinimumDuration(750);
-  m_progressDialog->setWindowTitle(tr("Saving File in Progress…"));
-  m_progressDialog->setLabelText(
+  showFileProgress(
+    id, tr("Saving File in Progress…"),
     tr("Saving file “%1”\nwith “%2”", "%1 = file name, %2 = format")
       .arg(fileName)
       .arg(ident));
-  /// @todo Add API to abort file ops
-  m_progressDialog->setCancelButton(nullptr);
-  connect(m_fileWriteThread, &QThread::started, m_threadedWriter,
-          &BackgroundFileFormat::write);
-  connect(m_threadedWriter, &BackgroundFileFormat::finished, m_fileWriteThread,
-          &QThread::quit);
-
-  // Start the file operation
-  m_progressDialog->show();
-  if (async) {
-    connect(m_threadedWriter, &BackgroundFileFormat::finished, this,
-            &MainWindow::backgroundWriterFinished);
-    m_fileWriteThread->start();
-    return true;
-  } else {
-    QTimer::singleShot(0, m_fileWriteThread, SLOT(start()));
-    QEventLoop loop;
-    connect(m_fileWriteThread, &QThread::finished, &loop, &QEventLoop::quit);
-    loop.exec();
-    return backgroundWriterFinished();
-  }
+  return true;
 }
 
 void MainWindow::setActiveTool(QString toolName)
 {
   if (auto* glWidget =
         qobject_cast<GLWidget*>(m_multiViewWidget->activeWidget())) {
-    foreach (ToolPlugin* toolPlugin, glWidget->tools()) {
-      if (toolPlugin->objectName() == toolName) {
-        toolPlugin->activateAction()->triggered();
-        glWidget->setActiveTool(toolPlugin);
+    if (ToolPlugin* toolPlugin = viewTool(glWidget, toolName)) {
+      toolPlugin->activateAction()->triggered();
+      glWidget->setActiveTool(toolPlugin);
 
-        // update the settings widget
-        m_toolDock->setWidget(toolPlugin->toolWidget());
-        m_toolDock->setWindowTitle(toolPlugin->activateAction()->text());
-      }
+      // update the settings widget
+      m_toolDock->setWidget(toolPlugin->toolWidget());
+      m_toolDock->setWindowTitle(toolPlugin->activateAction()->text());
     }
   }
 
@@ -1947,6 +2586,15 @@ void MainWindow::buildMenu()
   m_menuBuilder->addAction(path, action, 998);
   m_fileToolBar->addAction(action);
   connect(action, &QAction::triggered, this, &MainWindow::importFile);
+  // Open Library
+  action = new QAction(tr("Open &Library…"), this);
+  m_menuBuilder->addAction(path, action, 997);
+  connect(action, &QAction::triggered, this,
+          static_cast<void (MainWindow::*)()>(&MainWindow::openLibrary));
+  // Open Folder
+  action = new QAction(tr("Open &Folder…"), this);
+  m_menuBuilder->addAction(path, action, 996);
+  connect(action, &QAction::triggered, this, &MainWindow::openFolder);
 
   action = new QAction(tr("&Close"), this);
   action->setShortcut(QKeySequence::Close);
@@ -1986,7 +2634,7 @@ void MainWindow::buildMenu()
   action = new QAction(tr("&Molecule…"), this);
   m_menuBuilder->addAction(exportPath, action, 110);
 #ifndef Q_OS_MAC
-  action->setIcon(QIcon::fromTheme("document-export"));
+  deferIcon(action, "document-export");
 #endif
   connect(action, SIGNAL(triggered()), this, SLOT(exportFile()));
   // Export action for toolbar with more clear name
@@ -2000,7 +2648,7 @@ void MainWindow::buildMenu()
   action = new QAction(tr("&Graphics…"), this);
   m_menuBuilder->addAction(exportPath, action, 100);
 #ifndef Q_OS_MAC
-  action->setIcon(QIcon::fromTheme("document-export"));
+  deferIcon(action, "document-export");
 #endif
   connect(action, &QAction::triggered, this,
           static_cast<void (MainWindow::*)()>(&MainWindow::exportGraphics));
@@ -2009,7 +2657,7 @@ void MainWindow::buildMenu()
   action = new QAction(tr("&Quit"), this);
   action->setShortcut(QKeySequence::Quit);
 #ifndef Q_OS_MAC
-  action->setIcon(QIcon::fromTheme("application-exit"));
+  deferIcon(action, "application-exit");
 #endif
   m_menuBuilder->addAction(path, action, -200);
   connect(action, &QAction::triggered, this, &QWidget::close);
@@ -2022,7 +2670,7 @@ void MainWindow::buildMenu()
     action = new QAction(QString::number(i), this);
     m_actionRecentFiles.push_back(action);
 #ifndef Q_OS_MAC
-    action->setIcon(QIcon::fromTheme("document-open-recent"));
+    deferIcon(action, "document-open-recent");
 #endif
     action->setVisible(false);
     m_menuBuilder->addAction(path, action, 995 - i);
@@ -2037,18 +2685,18 @@ void MainWindow::buildMenu()
   editPath << tr("&Edit");
   m_undo = new QAction(tr("&Undo"), this);
 #ifndef Q_OS_MAC
-  m_undo->setIcon(QIcon::fromTheme("edit-undo"));
+  deferIcon(m_undo, "edit-undo");
 #endif
   m_undo->setShortcut(QKeySequence::Undo);
   m_redo = new QAction(tr("&Redo"), this);
 #ifndef Q_OS_MAC
-  m_redo->setIcon(QIcon::fromTheme("edit-redo"));
+  deferIcon(m_redo, "edit-redo");
 #endif
   m_redo->setShortcut(QKeySequence::Redo);
 
   m_copyImage = new QAction(tr("&Copy Graphics"), this);
 #ifndef Q_OS_MAC
-  m_copyImage->setIcon(QIcon::fromTheme("edit-copy"));
+  deferIcon(m_copyImage, "edit-copy");
 #endif
   m_copyImage->setShortcut(tr("Ctrl+Alt+C"));
 
@@ -2111,14 +2759,18 @@ void MainWindow::buildMenu()
 
   action = new QAction(tr("&Periodic Table…"), this);
   m_menuBuilder->addAction(extensionsPath, action, 0);
-  auto* periodicTable = new QtGui::PeriodicTableView(this);
-  connect(action, &QAction::triggered, periodicTable, &QWidget::show);
+  // Created the first time it is asked for.
+  connect(action, &QAction::triggered, this, [this]() {
+    if (!m_periodicTable)
+      m_periodicTable = new QtGui::PeriodicTableView(this);
+    m_periodicTable->show();
+  });
 
   QStringList helpPath;
   helpPath << tr("&Help");
   auto* about = new QAction(tr("&About"), this);
 #ifndef Q_OS_MAC
-  about->setIcon(QIcon::fromTheme("help-about"));
+  deferIcon(about, "help-about");
 #endif
   m_menuBuilder->addAction(helpPath, about, 500);
   connect(about, &QAction::triggered, this, &MainWindow::showAboutDialog);
@@ -2149,14 +2801,261 @@ void MainWindow::buildMenu(QtGui::ExtensionPlugin* extension)
     m_menuBuilder->addAction(extension->menuPath(action), action);
 }
 
+ExtensionPlugin* MainWindow::createExtension(ExtensionPluginFactory* factory)
+{
+  ExtensionPlugin* extension =
+    factory->createInstance(QCoreApplication::instance());
+  if (!extension)
+    return nullptr;
+
+  m_extensionIdentifiers.insert(extension, factory->identifier());
+  extension->setParent(this);
+  connect(this, &MainWindow::moleculeChanged, extension,
+          &QtGui::ExtensionPlugin::setMolecule);
+  connect(extension, &QtGui::ExtensionPlugin::moleculeReady, this,
+          &MainWindow::moleculeReady);
+  connect(extension, &QtGui::ExtensionPlugin::fileFormatsReady, this,
+          &MainWindow::fileFormatsReady);
+  connect(extension, &QtGui::ExtensionPlugin::requestActiveTool, this,
+          &MainWindow::setActiveTool);
+  connect(extension, &QtGui::ExtensionPlugin::requestActiveDisplayTypes, this,
+          &MainWindow::setActiveDisplayTypes);
+  connect(extension, &QtGui::ExtensionPlugin::registerCommand, this,
+          &MainWindow::registerExtensionCommand);
+  extension->registerCommands();
+
+  m_extensions.append(extension);
+  return extension;
+}
+
+void MainWindow::addExtensionProxy(ExtensionPluginFactory* factory,
+                                   const PluginManifest::ExtensionEntry& entry)
+{
+  m_lazyExtensions.insert(entry.identifier, factory);
+
+  QList<QAction*> proxies;
+  foreach (const PluginManifest::ActionEntry& actionEntry, entry.actions) {
+    auto* action = new QAction(actionEntry.text, this);
+    if (!actionEntry.shortcut.isEmpty()) {
+      action->setShortcut(
+        QKeySequence(actionEntry.shortcut, QKeySequence::PortableText));
+    }
+#ifndef Q_OS_MAC
+    if (!actionEntry.iconName.isEmpty())
+      deferIcon(action, actionEntry.iconName);
+#endif
+    action->setCheckable(actionEntry.checkable);
+    action->setChecked(actionEntry.checked);
+    action->setProperty("extension", entry.identifier);
+    m_menuBuilder->addAction(actionEntry.menuPath, action,
+                             actionEntry.priority);
+    connect(action, &QAction::triggered, this,
+            &MainWindow::extensionProxyTriggered);
+    proxies << action;
+  }
+  m_proxyActions.insert(entry.identifier, proxies);
+
+  for (auto it = entry.commands.constBegin(); it != entry.commands.constEnd();
+       ++it) {
+    m_commandDescriptionsMap.insert(it.key(), it.value());
+    m_lazyCommandMap.insert(it.key(), entry.identifier);
+  }
+}
+
+ExtensionPlugin* MainWindow::instantiateExtension(const QString& identifier)
+{
+  ExtensionPluginFactory* factory = m_lazyExtensions.take(identifier);
+  if (!factory)
+    return nullptr;
+
+  // The stubs are replaced by the commands the instance registers.
+  foreach (const QString& command, m_lazyCommandMap.keys(identifier))
+    m_lazyCommandMap.remove(command);
+
+  ExtensionPlugin* extension = createExtension(factory);
+  QList<QAction*> proxies = m_proxyActions.take(identifier);
+  if (!extension) {
+    foreach (QAction* proxy, proxies)
+      proxy->setEnabled(false);
+    return nullptr;
+  }
+  qCDebug(lcStartup) << "Extension created on first use:" << identifier;
+
+  // Bring the new instance up to date with the rest of the application.
+  if (auto* glWidget =
+        qobject_cast<GLWidget*>(m_multiViewWidget->activeWidget())) {
+    extension->setScene(&glWidget->renderer().scene());
+    extension->setCamera(&glWidget->renderer().camera());
+    extension->setActiveWidget(glWidget);
+  }
+  if (m_molecule)
+    extension->setMolecule(m_molecule);
+
+  // The proxies stay in the menus, forwarding to the real actions.
+  QList<QAction*> actions = extension->actions();
+  for (int i = 0; i < proxies.size(); ++i) {
+    QAction* proxy = proxies[i];
+    QAction* action = nullptr;
+    if (i < actions.size() && actions[i]->text() == proxy->text()) {
+      action = actions[i];
+    } else {
+      foreach (QAction* candidate, actions) {
+        if (candidate->text() == proxy->text()) {
+          action = candidate;
+          break;
+        }
+      }
+    }
+
+    disconnect(proxy, &QAction::triggered, this,
+               &MainWindow::extensionProxyTriggered);
+    if (!action) {
+      proxy->setEnabled(false);
+      continue;
+    }
+    m_proxyTargets.insert(proxy, action);
+    syncProxyAction(proxy, action);
+    connect(action, &QAction::changed, proxy,
+            [proxy, action]() { syncProxyAction(proxy, action); });
+    connect(proxy, &QAction::triggered, action, &QAction::trigger);
+  }
+
+  return extension;
+}
+
+void MainWindow::syncProxyAction(QAction* proxy, const QAction* action)
+{
+  proxy->setText(action->text());
+  proxy->setToolTip(action->toolTip());
+  proxy->setEnabled(action->isEnabled());
+  proxy->setVisible(action->isVisible());
+  proxy->setCheckable(action->isCheckable());
+  const bool blocked = proxy->blockSignals(true);
+  proxy->setChecked(action->isChecked());
+  proxy->blockSignals(blocked);
+#ifndef Q_OS_MAC
+  if (!action->icon().isNull())
+    proxy->setIcon(action->icon());
+#endif
+}
+
+void MainWindow::extensionProxyTriggered()
+{
+  auto* proxy = qobject_cast<QAction*>(sender());
+  if (!proxy)
+    return;
+
+  instantiateExtension(proxy->property("extension").toString());
+
+  // Later triggers are forwarded directly, this one must be passed on.
+  QAction* action = m_proxyTargets.value(proxy);
+  if (action)
+    action->trigger();
+}
+
+void MainWindow::updatePluginManifest(ExtensionPluginFactory* factory,
+                                      ExtensionPlugin* extension)
+{
+  if (m_pluginManifest->isValid())
+    return;
+
+  PluginManifest::ExtensionEntry entry;
+  entry.identifier = factory->identifier();
+  entry.description = factory->description();
+  foreach (QAction* action, extension->actions()) {
+    entry.actions << PluginManifest::actionEntry(action,
+                                                 extension->menuPath(action));
+  }
+  // Commands are registered synchronously by registerCommands().
+  for (auto it = m_extensionCommandMap.constBegin();
+       it != m_extensionCommandMap.constEnd(); ++it) {
+    if (it.value() == extension)
+      entry.commands.insert(it.key(), m_commandDescriptionsMap.value(it.key()));
+  }
+  m_pluginManifest->setExtension(entry);
+}
+
 // TODO: this would be a lovely C++11 lambda
 bool ToolSort(const ToolPlugin* a, const ToolPlugin* b)
 {
   return a->priority() < b->priority();
 }
 
+void MainWindow::updateTranslationList()
+{
+  QFileInfo info(m_translationPath);
+  QString path = info.canonicalFilePath();
+  QString modified =
+    QString::number(info.lastModified().toMSecsSinceEpoch());
+
+  QSettings settings;
+  settings.beginGroup("translations");
+  if (settings.value("path").toString() == path &&
+      settings.value("modified").toString() == modified) {
+    m_translationList = settings.value("languages").toStringList();
+    m_localeCodes = settings.value("codes").toStringList();
+    if (!m_translationList.isEmpty() &&
+        m_translationList.size() == m_localeCodes.size())
+      return;
+  }
+
+  // Go through the possible translations / locale codes
+  // to get the localized names for the language dialog
+  QDir dir(m_translationPath);
+  QStringList files =
+    dir.entryList(QStringList() << "avogadroapp*.qm", QDir::Files);
+  QStringList languages, codes;
+
+  languages << "System"; // we handle this in the dialog
+  codes << "";           // default is the system language
+
+  bool addedUS = false;
+
+  // check what files exist
+  foreach (const QString& file, files) {
+    // remove "avogadroapp-" and the ".qm"
+    QString localeCode = file.left(file.indexOf('.')).remove("avogadroapp-");
+
+    if (localeCode.startsWith("en") && !addedUS) {
+      // add US English (default)
+      addedUS = true;
+      QLocale us("en_US");
+      languages << us.nativeLanguageName();
+      codes << "en_US";
+    }
+
+    QLocale locale(localeCode);
+    QString languageName = locale.nativeLanguageName();
+    if (languageName.isEmpty() && localeCode == "oc")
+      languageName = "Occitan";
+    // potentially other exceptions here
+
+    // cases like Brazilian Portuguese show up as duplicates
+    if (languages.contains(languageName)) {
+      languageName += " (" + locale.nativeCountryName() + ")";
+    }
+
+    languages << languageName;
+    codes << localeCode;
+  }
+
+  m_translationList = languages;
+  m_localeCodes = codes;
+
+  if (m_disableSettings)
+    return;
+  settings.setValue("path", path);
+  settings.setValue("modified", modified);
+  settings.setValue("languages", languages);
+  settings.setValue("codes", codes);
+  settings.endGroup();
+}
+
 void MainWindow::showLanguageDialog()
 {
+  if (m_translationList.isEmpty())
+    updateTranslationList();
+
   bool ok;
   int currentIndex = 0;
   m_translationList[0] = tr("System Language");
@@ -2193,11 +3092,13 @@ void MainWindow::buildTools()
   QList<ToolPluginFactory*> toolPluginFactories =
     plugin->pluginFactories<ToolPluginFactory>();
   foreach (ToolPluginFactory* factory, toolPluginFactories) {
-    ToolPlugin* tool = factory->createInstance(QCoreApplication::instance());
-    tool->setParent(this);
-    tool->setIcon(darkMode);
-    if (tool)
+    StartupProfiler::Scope scope(factory->identifier(), "tool");
+    ToolPlugin* tool = factory->createInstance(this);
+    if (tool) {
+      tool->setIcon(darkMode);
       m_tools << tool;
+      m_toolFactories.insert(tool->objectName(), factory);
+    }
   }
 
   // sort them based on priority
@@ -2230,6 +3131,19 @@ void MainWindow::buildTools()
   }
 }
 
+bool MainWindow::hasFileReader(const QString& fileName)
+{
+  // Some formats are known by the full file name rather than the extension.
+  FileFormatManager& ffm = FileFormatManager::instance();
+  QFileInfo info(CompressedStreamBuf::baseFileName(fileName));
+  const FileFormat::Operations ops = FileFormat::File | FileFormat::Read;
+  return !ffm.fileFormatsFromFileExtension(
+                info.suffix().toLower().toStdString(), ops)
+            .empty() ||
+         !ffm.fileFormatsFromFileExtension(info.fileName().toStdString(), ops)
+            .empty();
+}
+
 QString MainWindow::extensionToWildCard(const QString& extension)
 {
   // This is a list of "extensions" returned by OB that are not actually
@@ -2287,7 +3201,7 @@ QString MainWindow::generateFilterString(
   return result;
 }
 
-bool MainWindow::saveFileIfNeeded()
+bool MainWindow::saveFileIfNeeded(const std::function<void()>& retry)
 {
   if (m_moleculeDirty) {
     // We're using the property interface to QMessageBox, rather than
@@ -2320,12 +3234,15 @@ bool MainWindow::saveFileIfNeeded()
 
     switch (static_cast<QMessageBox::StandardButton>(response)) {
       case QMessageBox::Save:
-        // Synchronous save -- needed so that we don't lose changes if the
-        // writer
-        // fails:
-        return saveFile(/*async=*/false);
+        // Saved in the background, the caller tries again once the file is
+        // written. Nothing happens if the save fails, so no changes are lost.
+        m_afterSave = retry;
+        saveFile();
+        m_afterSave = nullptr;
+        return false;
       case QMessageBox::Discard:
         markMoleculeClean();
+        m_autoSaver->discard(m_molecule);
         return true;
       default:
       case QMessageBox::Cancel:
@@ -2339,28 +3256,98 @@ bool MainWindow::saveFileIfNeeded()
 void MainWindow::registerMoleQueue()
 {
 #ifdef Avogadro_ENABLE_RPC
-  MoleQueue::Client client;
-  if (!client.connectToServer() || !client.isConnected())
-    return;
-
   // Get all extensions;
   typedef std::vector<std::string> StringList;
   FileFormatManager& ffm = FileFormatManager::instance();
   StringList exts = ffm.fileExtensions(FileFormat::Read | FileFormat::File);
 
   // Create patterns list
-  QList<QRegExp> patterns;
-  for (auto it = exts.begin(), itEnd = exts.end(); it != itEnd; ++it) {
-    patterns << QRegExp(extensionToWildCard(QString::fromStdString(*it)),
-                        Qt::CaseInsensitive, QRegExp::Wildcard);
+  QStringList wildcards;
+  for (auto it = exts.begin(), itEnd = exts.end(); it != itEnd; ++it)
+    wildcards << extensionToWildCard(QString::fromStdString(*it));
+  wildcards.sort();
+  wildcards.removeDuplicates();
+
+  // Only register again when the formats or the executable have changed.
+  QString executable = qApp->applicationFilePath();
+  QString key = executable + '\n' + wildcards.join('\n');
+  QByteArray hash =
+    QCryptographicHash::hash(key.toUtf8(), QCryptographicHash::Sha1).toHex();
+  if (!m_disableSettings &&
+      QSettings().value("moleQueue/registration").toByteArray() == hash) {
+    return;
   }
 
-  // Register the executable:
-  client.registerOpenWith("Avogadro2 (new)", qApp->applicationFilePath(),
-                          patterns);
+  // A server that is busy or hung could stall the connection, probe it on a
+  // worker with a bounded wait. The GUI thread only connects once it is known
+  // to accept connections.
+  QPointer<MainWindow> window(this);
+  QtConcurrent::run([window, executable, wildcards, hash]() {
+    QLocalSocket probe;
+    probe.connectToServer("MoleQueue");
+    if (!probe.waitForConnected(2000))
+      return;
+    probe.disconnectFromServer();
+    QMetaObject::invokeMethod(
+      qApp,
+      [window, executable, wildcards, hash]() {
+        if (window)
+          window->registerOpenWith(executable, wildcards, hash);
+      },
+      Qt::QueuedConnection);
+  });
+#endif // Avogadro_ENABLE_RPC
+}
 
-  client.registerOpenWith("Avogadro2 (running)", "avogadro", "openFile",
-                          patterns);
+void MainWindow::registerOpenWith(const QString& executable,
+                                  const QStringList& wildcards,
+                                  const QByteArray& hash)
+{
+#ifdef Avogadro_ENABLE_RPC
+  auto* client = new MoleQueue::Client(this);
+  if (!client->connectToServer() || !client->isConnected()) {
+    client->deleteLater();
+    return;
+  }
+
+  QList<QRegExp> patterns;
+  foreach (const QString& wildcard, wildcards)
+    patterns << QRegExp(wildcard, Qt::CaseInsensitive, QRegExp::Wildcard);
+
+  // The registration is remembered once the server accepted both handlers.
+  auto pending = std::make_shared<QSet<int>>();
+  bool remember = !m_disableSettings;
+  connect(client, &MoleQueue::Client::registerOpenWithResponse, this,
+          [client, pending, hash, remember](int localId) {
+            if (!pending->remove(localId) || !pending->isEmpty())
+              return;
+            if (remember)
+              QSettings().setValue("moleQueue/registration", hash);
+            client->deleteLater();
+          });
+  connect(client, &MoleQueue::Client::errorReceived, this,
+          [client, pending](int localId, unsigned int, const QString& error) {
+            if (!pending->contains(localId))
+              return;
+            qWarning() << "MoleQueue did not register Avogadro:" << error;
+            client->deleteLater();
+          });
+
+  // Register the executable:
+  pending->insert(
+    client->registerOpenWith("Avogadro2 (new)", executable, patterns));
+  pending->insert(client->registerOpenWith("Avogadro2 (running)", "avogadro",
+                                           "openFile", patterns));
+  if (pending->contains(-1)) {
+    client->deleteLater();
+    return;
+  }
+  // Give up on a server that never answers, nothing is remembered then.
+  QTimer::singleShot(30000, client, &QObject::deleteLater);
+#else
+  Q_UNUSED(executable)
+  Q_UNUSED(wildcards)
+  Q_UNUSED(hash)
 #endif // Avogadro_ENABLE_RPC
 }
 
@@ -2382,23 +3369,49 @@ void MainWindow::openURL(const QString& url)
 
 void MainWindow::checkUpdate()
 {
+  // At most one check per interval, so machines without network access are
+  // not held up on every start.
+  QSettings settings;
+  settings.beginGroup("updateCheck");
+  int interval = settings.value("interval", 24).toInt(); // hours
+  QDateTime lastCheck = settings.value("lastCheck").toDateTime();
+  QDateTime now = QDateTime::currentDateTimeUtc();
+  if (interval < 0 ||
+      (lastCheck.isValid() && lastCheck.secsTo(now) < interval * 3600)) {
+    return;
+  }
+  if (!m_disableSettings)
+    settings.setValue("lastCheck", now);
+
+  // The release information can be redirected, e.g. to a file:// URL.
+  QString url = qEnvironmentVariable("AVOGADRO_UPDATE_URL");
+  if (url.isEmpty()) {
+    url = settings
+            .value("url", "https://api.github.com/repos/openchemistry/"
+                          "avogadrolibs/releases/latest")
+            .toString();
+  }
+  int timeout = settings.value("timeout", 10000).toInt(); // ms
+  settings.endGroup();
+
   if (m_network == nullptr) {
     m_network = new QNetworkAccessManager(this);
     connect(m_network, SIGNAL(finished(QNetworkReply*)), this,
             SLOT(finishUpdateRequest(QNetworkReply*)));
   }
 
-  m_network->get(
-    QNetworkRequest(QUrl("https://api.github.com/repos/openchemistry/"
-                         "avogadrolibs/releases/latest")));
+  QNetworkReply* reply =
+    m_network->get(QNetworkRequest(QUrl::fromUserInput(url)));
+  // The timer is cancelled if the reply finishes and is deleted first.
+  QTimer::singleShot(timeout, reply, &QNetworkReply::abort);
 }
 
 void MainWindow::finishUpdateRequest(QNetworkReply* reply)
 {
-  if (!reply->isReadable()) {
-    MESSAGEBOX::warning(this, tr("Network Download Failed"),
-                        tr("Network timeout or other error."));
-    reply->deleteLater();
+  reply->deleteLater();
+  // Not being able to reach the server is not worth interrupting the user.
+  if (reply->error() != QNetworkReply::NoError || !reply->isReadable()) {
+    qDebug() << "Update check failed:" << reply->errorString();
     return;
   }
 
@@ -2497,7 +3510,9 @@ void MainWindow::fileFormatsReady()
   auto* extension(qobject_cast<ExtensionPlugin*>(sender()));
   if (!extension)
     return;
+  QStringList formatIds;
   foreach (FileFormat* format, extension->fileFormats()) {
+    formatIds << QString::fromStdString(format->identifier());
     if (!FileFormatManager::registerFormat(format)) {
       qWarning() << tr("Error while loading the “%1” file format.")
                       .arg(QString::fromStdString(format->identifier()));
@@ -2505,37 +3520,220 @@ void MainWindow::fileFormatsReady()
       delete format;
     }
   }
+
+  // Remember which extensions provide formats, they arrive asynchronously.
+  const QString identifier = m_extensionIdentifiers.value(extension);
+  m_readiness->markReady(identifier);
+  const PluginManifest::ExtensionEntry* entry =
+    m_pluginManifest->extension(identifier);
+  if (entry && !formatIds.isEmpty()) {
+    bool known = true;
+    foreach (const QString& id, formatIds)
+      known = known && entry->fileFormats.contains(id);
+    if (!known) {
+      m_pluginManifest->setFileFormats(identifier, formatIds);
+      m_pluginManifest->save();
+    }
+  }
+
+  readQueuedFiles();
+}
+
+void MainWindow::openFiles(const QStringList& fileNames)
+{
+  m_queuedFiles << fileNames;
   readQueuedFiles();
+
+  // The request usually comes from the file manager, bring the window forward.
+  setWindowState((windowState() & ~Qt::WindowMinimized) | Qt::WindowActive);
+  raise();
+  activateWindow();
 }
 
 void MainWindow::readQueuedFiles()
 {
-  m_queuedFilesStarted = true;
-  if (!m_queuedFiles.empty()) {
-    QString file = m_queuedFiles.first();
-    m_queuedFiles.removeFirst();
+  // Reads run on the I/O workers, keep at most one per worker in flight so a
+  // drop of hundreds of files does not hold up a save.
+  int slots =
+    m_fileJobs->maxThreadCount() - m_fileJobs->count(FileJobQueue::Read);
+  QStringList files;
+  bool moreFiles = false;
+  for (int i = 0; i < m_queuedFiles.size(); ++i) {
+    if (!hasFileReader(m_queuedFiles[i]))
+      continue;
+    if (files.size() >= slots) {
+      moreFiles = true;
+      break;
+    }
+    files << m_queuedFiles.takeAt(i--);
+  }
+
+  // A lone file is opened as usual, with its own progress dialog.
+  bool single = files.size() == 1 && !moreFiles && m_batchTotal == 0 &&
+                m_fileJobs->count(FileJobQueue::Read) == 0;
+  foreach (const QString& file, files) {
     const FileFormat* format = QtGui::FileFormatDialog::findFileFormat(
-      this, tr("Select file format"), file, FileFormat::File | FileFormat::Read,
-      "Avogadro:");
+      this, tr("Select file format"), CompressedStreamBuf::baseFileName(file),
+      FileFormat::File | FileFormat::Read, "Avogadro:");
+    if (single) {
+      if (!openFile(file, format ? format->newInstance() : nullptr)) {
+        MESSAGEBOX::warning(this, tr("Cannot open file"),
+                            tr("Avogadro cannot open"
+                               " “%1”.")
+                              .arg(file));
+      }
+    } else {
+      startBatchRead(file, format ? format->newInstance() : nullptr);
+    }
+  }
 
-    if (!openFile(file, format ? format->newInstance() : nullptr)) {
-      MESSAGEBOX::warning(this, tr("Cannot open file"),
+  // A plugin that is still loading may provide a reader for the rest.
+  if (m_readiness->isReady()) {
+    QStringList unreadable;
+    for (int i = 0; i < m_queuedFiles.size(); ++i) {
+      if (!hasFileReader(m_queuedFiles[i]))
+        unreadable << m_queuedFiles.takeAt(i--);
+    }
+    if (!unreadable.isEmpty()) {
+      MESSAGEBOX::warning(this, tr("Cannot open files"),
                           tr("Avogadro cannot open"
                              " “%1”.")
-                            .arg(file));
+                            .arg(unreadable.join("\n")));
+      finishStartup();
     }
   }
+  updateBatchProgress();
+}
+
+void MainWindow::emitReadChanges(Molecule* molecule, unsigned int changes)
+{
+  m_readingChanges = true;
+  molecule->emitChanged(changes);
+  m_readingChanges = false;
+}
+
+void MainWindow::setReadFileName(Molecule* molecule, const QString& fileName)
+{
+  auto recovered = m_recoveredFiles.find(fileName);
+  if (recovered != m_recoveredFiles.end()) {
+    if (recovered->isEmpty())
+      molecule->setData("fileName", Core::Variant());
+    else
+      molecule->setData("fileName", qPrintable(*recovered));
+    // Marked as modified by setMolecule(), so it is autosaved again.
+    molecule->setProperty("recovered", true);
+    m_recoveredFiles.erase(recovered);
+    return;
+  }
+
+  molecule->setData("fileName", qPrintable(fileName));
+  m_recentFiles.prepend(fileName);
+}
+
+void MainWindow::restoreRecoveredFiles()
+{
+  QList<AutoSaver::Recovered> recovered = m_autoSaver->recoverable();
+  if (recovered.isEmpty())
+    return;
+
+  QStringList names;
+  foreach (const AutoSaver::Recovered& copy, recovered) {
+    QString name = copy.originalFileName.isEmpty()
+                     ? tr("Untitled")
+                     : QFileInfo(copy.originalFileName).fileName();
+    names << tr("%1, saved %2", "%1 = file name, %2 = date and time")
+               .arg(name)
+               .arg(QLocale().toString(copy.saved, QLocale::ShortFormat));
+  }
+
+  int response = MESSAGEBOX::question(
+    this, tr("Recover Unsaved Changes"),
+    tr("Avogadro did not close normally. Restore the %n unsaved "
+       "molecule(s)?\n\n%1",
+       "", recovered.size())
+      .arg(names.join('\n')),
+    QMessageBox::Yes | QMessageBox::No, QMessageBox::Yes);
+  if (response != QMessageBox::Yes) {
+    m_autoSaver->discardRecovered();
+    return;
+  }
+
+  // Read together like any other queued files, then renamed.
+  foreach (const AutoSaver::Recovered& copy, recovered) {
+    m_recoveredFiles.insert(copy.fileName, copy.originalFileName);
+    m_queuedFiles << copy.fileName;
+  }
+  readQueuedFiles();
 }
 
-void MainWindow::clearQueuedFiles()
+void MainWindow::startBatchRead(const QString& fileName, Io::FileFormat* reader)
 {
-  if (!m_queuedFilesStarted && !m_queuedFiles.isEmpty()) {
+  ++m_batchTotal;
+  if (!reader) {
+    ++m_batchDone;
+    m_batchErrors << tr("%1: no file format selected", "%1 = file name")
+                       .arg(fileName);
+    return;
+  }
+
+  auto* molecule = new Molecule(this);
+  molecule->setData("fileName", qPrintable(fileName));
+  m_batchJobs.insert(m_fileJobs->read(fileName, reader, molecule));
+}
+
+void MainWindow::updateBatchProgress()
+{
+  if (m_batchTotal == 0)
+    return;
+
+  if (!m_batchProgress) {
+    m_batchProgress = new QProgressDialog(this);
+    m_batchProgress->setWindowTitle(tr("Reading Files"));
+    m_batchProgress->setMinimumDuration(750);
+    m_batchProgress->setAutoReset(false);
+    m_batchProgress->setAutoClose(false);
+    connect(m_batchProgress, &QProgressDialog::canceled, this,
+            &MainWindow::cancelQueuedFiles);
+  }
+  int total = m_batchTotal + m_queuedFiles.size();
+  m_batchProgress->setRange(0, total);
+  m_batchProgress->setValue(m_batchDone);
+  m_batchProgress->setLabelText(
+    tr("Read %1 of %2 files", "%1 = files read, %2 = total")
+      .arg(m_batchDone)
+      .arg(total));
+  if (!m_batchJobs.isEmpty() || !m_queuedFiles.isEmpty())
+    return;
+
+  // All done, switch to the last molecule read only now.
+  m_batchProgress->hide();
+  m_batchProgress->deleteLater();
+  m_batchProgress = nullptr;
+  if (m_batchMolecule) {
+    setMolecule(m_batchMolecule);
+    moleculeShown();
+    restoreCamera(m_batchMolecule);
+    updateRecentFiles();
+  }
+  statusBar()->showMessage(tr("Finished reading %n file(s)", "", m_batchDone),
+                           5000);
+  if (!m_batchErrors.isEmpty()) {
     MESSAGEBOX::warning(this, tr("Cannot open files"),
-                        tr("Avogadro cannot open"
-                           " “%1”.")
-                          .arg(m_queuedFiles.join("\n")));
-    m_queuedFiles.clear();
+                        tr("Errors occurred while reading:\n%1")
+                          .arg(m_batchErrors.join("\n")));
   }
+  m_batchMolecule = nullptr;
+  m_batchErrors.clear();
+  m_batchTotal = m_batchDone = 0;
+  reassignCustomElements();
+  finishStartup();
+}
+
+void MainWindow::cancelQueuedFiles()
+{
+  m_queuedFiles.clear();
+  foreach (int id, m_batchJobs)
+    m_fileJobs->cancel(id);
 }
 
 void MainWindow::registerToolCommand(QString command, QString description)
@@ -2615,20 +3813,28 @@ bool MainWindow::handleCommand(const QString& command,
     QString toolName = m_toolCommandMap.value(command);
     auto* currentTool = glWidget->activeTool();
 
-    // find the requested tool
+    // find the requested tool, the commands are registered by name
     auto* tool = currentTool;
-    foreach (ToolPlugin* toolPlugin, glWidget->tools()) {
-      if (toolPlugin->name() == toolName) {
+    foreach (ToolPlugin* toolbarTool, m_tools) {
+      if (toolbarTool->name() != toolName)
+        continue;
+      if (ToolPlugin* toolPlugin =
+            viewTool(glWidget, toolbarTool->objectName())) {
         glWidget->setActiveTool(toolPlugin);
         tool = toolPlugin;
-        break;
       }
+      break;
     }
 
     bool result = tool->handleCommand(command, options);
     glWidget->setActiveTool(currentTool);
     return result;
-  } else if (m_extensionCommandMap.contains(command)) {
+  } else if (m_lazyCommandMap.contains(command)) {
+    // Create the extension, it registers the real command handler.
+    instantiateExtension(m_lazyCommandMap.value(command));
+  }
+
+  if (m_extensionCommandMap.contains(command)) {
     auto* extension = m_extensionCommandMap.value(command);
     return extension->handleCommand(command, options);
   }
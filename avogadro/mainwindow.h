@@ -6,16 +6,22 @@
 #ifndef AVOGADRO_MAINWINDOW_H
 #define AVOGADRO_MAINWINDOW_H
 
+#include <QtCore/QPointer>
+#include <QtCore/QSet>
 #include <QtCore/QStringList>
 #include <QtCore/QVariantMap>
 #include <QtWidgets/QMainWindow>
 
+#include "pluginmanifest.h"
+
+#include <functional>
+
 #ifdef QTTESTING
 class pqTestUtility;
 #endif
 
+class QProgressBar;
 class QProgressDialog;
-class QThread;
 class QTreeView;
 class QNetworkAccessManager;
 class QNetworkReply;
@@ -26,8 +32,13 @@ class AboutDialog;
 
 namespace Avogadro {
 
+class AutoSaver;
 class BackgroundFileFormat;
+class FileJobQueue;
+class IdleTaskQueue;
+class LibraryModel;
 class MenuBuilder;
+class ReadinessBarrier;
 class ViewFactory;
 
 namespace QtOpenGL {
@@ -41,9 +52,12 @@ class FileFormat;
 namespace QtGui {
 class ScenePlugin;
 class ToolPlugin;
+class ToolPluginFactory;
 class ExtensionPlugin;
+class ExtensionPluginFactory;
 class Molecule;
 class MoleculeModel;
+class PeriodicTableView;
 class MultiViewWidget;
 class RWMolecule;
 class LayerModel;
@@ -91,6 +105,14 @@ public slots:
    */
   bool openFile(const QString& fileName, Io::FileFormat* reader = nullptr);
 
+  /**
+   * Queue @a fileNames to be read, e.g. files passed on from another instance
+   * of the application. They are read concurrently on the FileJobQueue
+   * workers, up to 4 at a time, and the last one read is made active once
+   * all are done.
+   */
+  void openFiles(const QStringList& fileNames);
+
   void exportGraphics(QString fileName);
 
   /**
@@ -137,13 +159,10 @@ public:
   void readSettings();
 
   /**
-   * Set the list of possible translations
+   * Set the directory holding the translations, used to build the list of
+   * possible languages when the language dialog is first shown.
    */
-  void setTranslationList(const QStringList& list, const QStringList& codes)
-  {
-    m_translationList = list;
-    m_localeCodes = codes;
-  }
+  void setTranslationPath(const QString& path) { m_translationPath = path; }
 
   /**
    * Handle script commands
@@ -197,6 +216,18 @@ protected slots:
    */
   void importFile();
 
+  /**
+   * Prompt for a file holding several structures and list them in the
+   * library dock, see openLibrary(const QString&, Io::FileFormat*).
+   */
+  void openLibrary();
+
+  /**
+   * Prompt for a folder and list the structure files it holds in the library
+   * dock. Their atom counts and formulas are filled in while browsing.
+   */
+  void openFolder();
+
   /**
    * Open file in the recent files list.
    */
@@ -300,43 +331,56 @@ private slots:
 
   void registerExtensionCommand(QString command, QString description);
 
+  /**
+   * @brief Called when a proxy action for an extension that has not been
+   * created yet is triggered. Creates the extension and forwards the trigger.
+   */
+  void extensionProxyTriggered();
+
   /**
    * @brief Register file formats from extensions when ready.
    */
   void fileFormatsReady();
 
   /**
-   * @brief Attempt to read any files requested on the command line, intended to
-   * be called after the fileFormatsReady slot is triggered for formats added by
-   * extensions. Any that are successfully read will be removed from the list,
-   * after the timeout triggers the list will be cleared.
+   * @brief Attempt to read any files requested on the command line, called
+   * whenever file formats are added by extensions. A file is opened as soon as
+   * a reader for it is registered, files without a reader are only given up
+   * once no plugin is still expected to provide formats.
    */
   void readQueuedFiles();
 
   /**
-   * @brief Clear the list of queued files, triggered by a timeout to allow
-   * delayed file readying within the first few seconds of application start up.
+   * @brief Cancel the reads started by readQueuedFiles() and drop the files
+   * still waiting in the queue.
    */
-  void clearQueuedFiles();
+  void cancelQueuedFiles();
 
   /**
    * @brief Register molequeue open-with handlers for RPC and executable file
-   * handling. Called 5 seconds after startup to give extensions a chance to
-   * register file formats.
+   * handling. Called once the plugins have registered their file formats,
+   * skipped if the formats and executable are unchanged since the last
+   * launch. The server is probed on a worker thread with a bounded wait,
+   * registerOpenWith() then registers with it.
    */
   void registerMoleQueue();
 
   /**
-   * @brief The background file reader thread has completed, set the active
-   * molecule, and clean up after the threaded read.
+   * @brief A read or write on the I/O workers has completed, dispatch to
+   * backgroundReaderFinished() or backgroundWriterFinished().
+   */
+  void fileJobFinished(int id);
+
+  /**
+   * @brief The first frame of the trajectory read by the job @a id is ready,
+   * show it while the other frames are read.
    */
-  void backgroundReaderFinished();
+  void fileJobFirstFrame(int id);
 
   /**
-   * @brief The background file writer thread has completed, set the active
-   * molecule, and clean up after the threaded write.
+   * @brief Add the frames read so far by the job @a id to its molecule.
    */
-  bool backgroundWriterFinished();
+  void fileJobFrames(int id);
 
   /**
    * @brief Called when a toolbar action is clicked. The sender is expected to
@@ -351,6 +395,18 @@ private slots:
    */
   void viewConfigActivated();
 
+  /**
+   * @brief Called once the first frame of the initial view has been drawn,
+   * the end of application start up.
+   */
+  void firstFrameSwapped();
+
+  /**
+   * @brief Write the start up profile once the deferred work is done and the
+   * first of any files passed on the command line is shown.
+   */
+  void finishStartup();
+
   /**
    * @brief Triggered if a renderer cannot get a valid context.
    */
@@ -361,6 +417,11 @@ private slots:
    */
   void moleculeActivated(const QModelIndex& index);
 
+  /**
+   * @brief Parse the library entry @a index, if needed, and show it.
+   */
+  void libraryActivated(const QModelIndex& index);
+
   /**
    * @brief Change the active layer
    */
@@ -396,29 +457,75 @@ private:
   QtGui::MoleculeModel* m_moleculeModel;
   QtGui::LayerModel* m_layerModel;
   QtGui::ScenePlugin* m_activeScenePlugin;
-  bool m_queuedFilesStarted;
   QStringList m_queuedFiles;
+  ReadinessBarrier* m_readiness;
+  // start up work deferred until the first frame was drawn
+  IdleTaskQueue* m_idleTasks;
+  // menu icons, resolved from the theme once the window is shown
+  QList<QPair<QPointer<QAction>, QString>> m_deferredIcons;
 
   QStringList m_recentFiles;
   QList<QAction*> m_actionRecentFiles;
 
+  QString m_translationPath;
   QStringList m_translationList;
   QStringList m_localeCodes;
+  // started with --disable-settings, nothing is cached in the settings
+  bool m_disableSettings;
 
   MenuBuilder* m_menuBuilder;
+  PluginManifest* m_pluginManifest;
 
   // These variables take care of background file reading.
-  QThread* m_fileReadThread;
-  QThread* m_fileWriteThread;
-  BackgroundFileFormat* m_threadedReader;
-  BackgroundFileFormat* m_threadedWriter;
-  QProgressDialog* m_progressDialog;
-  QtGui::Molecule* m_fileReadMolecule;
+  FileJobQueue* m_fileJobs;
+  QMap<int, QProgressDialog*> m_jobDialogs;
+  // trajectories shown while the remaining frames are read, and their
+  // molecules, which can be closed before the read finishes
+  QMap<int, QProgressBar*> m_frameProgress;
+  QMap<int, QPointer<QtGui::Molecule>> m_frameMolecules;
+  // queued files read concurrently, the last one becomes active at the end
+  QSet<int> m_batchJobs;
+  QPointer<QtGui::Molecule> m_batchMolecule;
+  QStringList m_batchErrors;
+  QProgressDialog* m_batchProgress;
+  int m_batchTotal;
+  int m_batchDone;
 
   QToolBar* m_fileToolBar;
   QToolBar* m_toolToolBar;
 
   bool m_moleculeDirty;
+  // set while data read from a file is added to a molecule, not an edit
+  bool m_readingChanges;
+  // counts the changes of the active molecule, to tell whether it was edited
+  // while being saved
+  unsigned int m_editGeneration;
+  // saves in progress: the molecule saved, its generation and what to do once
+  // it is written
+  struct SaveJob
+  {
+    QPointer<QtGui::Molecule> molecule;
+    unsigned int generation;
+    std::function<void()> then;
+  };
+  QMap<int, SaveJob> m_saveJobs;
+  std::function<void()> m_afterSave;
+  bool m_closeAfterSave;
+  // recovery copies of unsaved molecules, and the copies being restored with
+  // the files they were edited from
+  AutoSaver* m_autoSaver;
+  QMap<QString, QString> m_recoveredFiles;
+
+  // records of multi-record files, parsed when selected, and the molecule
+  // showing them
+  LibraryModel* m_library;
+  QDockWidget* m_libraryDock;
+  QTreeView* m_libraryView;
+  QPointer<QtGui::Molecule> m_libraryMolecule;
+  // the first record of the last file opened, selected once it is found
+  int m_libraryFirstRow;
+  // the folder entry activated while its file is parsed, shown once read
+  int m_libraryReadRow;
 
   QtGui::MultiViewWidget* m_multiViewWidget;
   QTreeView* m_sceneTreeView;
@@ -429,8 +536,19 @@ private:
   QDockWidget* m_sceneDock;
   QDockWidget* m_layerDock;
   QDockWidget* m_moleculeDock;
+  // The tools of the toolbar, also used by the first view. Further views
+  // create their own instances, from the factories by object name.
   QList<QtGui::ToolPlugin*> m_tools;
+  QMap<QString, QtGui::ToolPluginFactory*> m_toolFactories;
+  bool m_toolbarToolsUsed;
   QList<QtGui::ExtensionPlugin*> m_extensions;
+  // map from extension instances to their factory identifiers
+  QMap<QtGui::ExtensionPlugin*, QString> m_extensionIdentifiers;
+  // extensions not created yet, with their proxy actions and command stubs
+  QMap<QString, QtGui::ExtensionPluginFactory*> m_lazyExtensions;
+  QMap<QString, QList<QAction*>> m_proxyActions;
+  QMap<QAction*, QPointer<QAction>> m_proxyTargets;
+  QMap<QString, QString> m_lazyCommandMap;
   // map from script commands to tools and extensions
   QMap<QString, QString> m_toolCommandMap;
   QMap<QString, QtGui::ExtensionPlugin*> m_extensionCommandMap;
@@ -446,6 +564,7 @@ private:
   ViewFactory* m_viewFactory;
 
   QNetworkAccessManager* m_network = nullptr;
+  QtGui::PeriodicTableView* m_periodicTable = nullptr;
 #ifdef _3DCONNEXION
   TDxController* m_TDxController;
 #endif
@@ -474,11 +593,172 @@ private:
    */
   void buildMenu(QtGui::ExtensionPlugin* extension);
 
+  /**
+   * Create an instance of the extension from @a factory and connect it to the
+   * main window.
+   */
+  QtGui::ExtensionPlugin* createExtension(
+    QtGui::ExtensionPluginFactory* factory);
+
+  /**
+   * Add proxy menu actions and command stubs for an extension described by the
+   * plugin manifest. The extension is created on first use.
+   */
+  void addExtensionProxy(QtGui::ExtensionPluginFactory* factory,
+                         const PluginManifest::ExtensionEntry& entry);
+
+  /**
+   * Create the deferred extension @a identifier, connecting its proxies.
+   * @return The new extension, or nullptr if it was already created.
+   */
+  QtGui::ExtensionPlugin* instantiateExtension(const QString& identifier);
+
+  /**
+   * Copy the state of @a action to the menu @a proxy.
+   */
+  static void syncProxyAction(QAction* proxy, const QAction* action);
+
+  /**
+   * Record the menu entries and commands of @a extension in the plugin
+   * manifest, unless the manifest was loaded from an up to date cache.
+   */
+  void updatePluginManifest(QtGui::ExtensionPluginFactory* factory,
+                            QtGui::ExtensionPlugin* extension);
+
+  /**
+   * Build the list of possible translations from m_translationPath. The list
+   * is cached in the settings, keyed on the modification time of the
+   * directory, unless the settings are disabled.
+   */
+  void updateTranslationList();
+
   /**
    * Initialize the tool plugins.
    */
   void buildTools();
 
+  /**
+   * @brief The background read @a id has completed, set the active molecule.
+   */
+  void backgroundReaderFinished(int id);
+
+  /**
+   * Read @a fileName as part of the current batch of queued files, see
+   * readQueuedFiles().
+   */
+  void startBatchRead(const QString& fileName, Io::FileFormat* reader);
+
+  /**
+   * Update the combined progress of the queued files, and make the last
+   * molecule read active once none are left.
+   */
+  void updateBatchProgress();
+
+  /**
+   * Record the time to the first molecule when a read molecule was made
+   * active, only the first one counts.
+   */
+  void moleculeShown();
+
+  /**
+   * Apply the camera stored with @a molecule by saveFileAs() to the active
+   * view, if any.
+   */
+  void restoreCamera(QtGui::Molecule* molecule);
+
+  /**
+   * @return The tool of @a glWidget with the object name @a name, created
+   * and added to the view if it has none yet, or nullptr if no tool has that
+   * name.
+   */
+  QtGui::ToolPlugin* viewTool(QtOpenGL::GLWidget* glWidget,
+                              const QString& name);
+
+  /**
+   * Emit @a changes for data read into @a molecule, e.g. the frames of a
+   * trajectory, without marking it modified or autosaving it.
+   */
+  void emitReadChanges(QtGui::Molecule* molecule, unsigned int changes);
+
+  /**
+   * Set the file name of @a molecule, read from @a fileName, and add it to
+   * the recent files. A recovered copy gets the name of the file it was
+   * edited from instead, and is marked as modified once active.
+   */
+  void setReadFileName(QtGui::Molecule* molecule, const QString& fileName);
+
+  /**
+   * List the records of @a fileName in the library dock, read with
+   * @a reader, which the library takes ownership of. The first record is
+   * shown once it is found.
+   * @return False if @a fileName does not hold records the library knows.
+   */
+  bool openLibrary(const QString& fileName, Io::FileFormat* reader);
+
+  /**
+   * Create the library dock on first use, and show it.
+   */
+  void showLibrary();
+
+  /**
+   * Offer to reopen the molecules autosaved by a session that did not close
+   * normally.
+   */
+  void restoreRecoveredFiles();
+
+  /**
+   * Register the open-with handlers for @a executable and the file patterns
+   * @a wildcards with the MoleQueue server, see registerMoleQueue(). @a hash
+   * is remembered once the server accepted both.
+   */
+  void registerOpenWith(const QString& executable,
+                        const QStringList& wildcards, const QByteArray& hash);
+
+  /**
+   * @brief The background write @a id has completed, mark the molecule clean.
+   * @return True if the file was saved.
+   */
+  bool backgroundWriterFinished(int id);
+
+  /**
+   * Report the outcome of @a writer, started for @a save, and mark the
+   * molecule clean unless it was edited since.
+   * @return True if the file was saved.
+   */
+  bool saveFinished(BackgroundFileFormat* writer, const SaveJob& save);
+
+  /**
+   * Show a progress dialog for the job @a id, canceling only that job. The
+   * dialog is removed by closeFileProgress().
+   * @{
+   */
+  void showFileProgress(int id, const QString& title, const QString& label);
+  void closeFileProgress(int id);
+  /**@}*/
+
+  /**
+   * Show the bytes processed by @a fileFormat in @a progressDialog, with
+   * the throughput and, when the size is known, the time remaining.
+   */
+  void trackFileProgress(QProgressDialog* progressDialog,
+                         BackgroundFileFormat* fileFormat);
+
+  /**
+   * Set the theme icon @a iconName on @a action once the window is shown, for
+   * actions that are only visible in the menus.
+   */
+  void deferIcon(QAction* action, const QString& iconName);
+
+  /**
+   * Resolve the icons recorded by deferIcon().
+   */
+  void loadDeferredIcons();
+
+  /**
+   * Set up the tree view of the layer dock, which is hidden at start up.
+   */
+  void setupLayerView();
+
   /**
    * Convenience function that converts a file extension to a wildcard
    * expression, e.g. "out" to "*.out". This method also checks for "extensions"
@@ -487,6 +767,11 @@ private:
    */
   static QString extensionToWildCard(const QString& extension);
 
+  /**
+   * @return True if a file format is registered that can read @a fileName.
+   */
+  static bool hasFileReader(const QString& fileName);
+
   /**
    * Convenience function to generate a filter string for the supplied formats.
    */
@@ -494,10 +779,13 @@ private:
     const std::vector<const Io::FileFormat*>& formats, bool addAllEntry = true);
 
   /**
-   * Prompt to save the current molecule if is has been modified. Returns false
-   * if the molecule is not saved, or the user cancels.
+   * Prompt to save the current molecule if is has been modified. Returns true
+   * if the caller can go ahead: the molecule was not modified or the user
+   * discarded the changes. Returns false if the user cancels, or chose to
+   * save: the file is then written in the background and @a retry, if set,
+   * is called once it was saved.
    */
-  bool saveFileIfNeeded();
+  bool saveFileIfNeeded(const std::function<void()>& retry = nullptr);
 };
 
 } // End Avogadro namespace
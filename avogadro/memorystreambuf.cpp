@@ -0,0 +1,82 @@
+/******************************************************************************
+  This source file is part of the Avogadro project.
+  This source code is released under the 3-Clause BSD License, (see "LICENSE").
+******************************************************************************/
+
+#include "memorystreambuf.h"
+
+#include <algorithm>
+
+namespace Avogadro {
+
+MemoryStreamBuf::MemoryStreamBuf(const char* data, std::size_t size,
+                                 const std::atomic_bool* canceled,
+                                 std::atomic<long long>* bytes,
+                                 std::size_t blockSize)
+  // std::streambuf wants mutable pointers, the data is never written.
+  : m_data(const_cast<char*>(data))
+  , m_size(size)
+  , m_blockSize(std::max<std::size_t>(blockSize, 1))
+  , m_canceled(canceled)
+  , m_bytes(bytes)
+  , m_wasCanceled(false)
+{
+  setg(m_data, m_data, m_data);
+}
+
+void MemoryStreamBuf::setWindow(std::size_t pos)
+{
+  std::size_t end = std::min(m_size, pos + m_blockSize);
+  setg(m_data, m_data + pos, m_data + end);
+  if (m_bytes)
+    m_bytes->store(static_cast<long long>(pos));
+}
+
+MemoryStreamBuf::int_type MemoryStreamBuf::underflow()
+{
+  if (gptr() < egptr())
+    return traits_type::to_int_type(*gptr());
+
+  if (m_canceled && m_canceled->load())
+    m_wasCanceled = true;
+  std::size_t pos = static_cast<std::size_t>(egptr() - m_data);
+  if (m_wasCanceled || pos >= m_size) {
+    if (m_bytes)
+      m_bytes->store(static_cast<long long>(pos));
+    return traits_type::eof();
+  }
+
+  setWindow(pos);
+  return traits_type::to_int_type(*gptr());
+}
+
+std::streamsize MemoryStreamBuf::showmanyc()
+{
+  std::size_t pos = static_cast<std::size_t>(gptr() - m_data);
+  return pos < m_size ? static_cast<std::streamsize>(m_size - pos) : -1;
+}
+
+MemoryStreamBuf::pos_type MemoryStreamBuf::seekoff(
+  off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which)
+{
+  off_type target = off;
+  if (dir == std::ios_base::cur)
+    target += gptr() - m_data;
+  else if (dir == std::ios_base::end)
+    target += static_cast<off_type>(m_size);
+  return seekpos(pos_type(target), which);
+}
+
+MemoryStreamBuf::pos_type MemoryStreamBuf::seekpos(
+  pos_type pos, std::ios_base::openmode which)
+{
+  off_type target = pos;
+  if (!(which & std::ios_base::in) || target < 0 ||
+      target > static_cast<off_type>(m_size)) {
+    return pos_type(off_type(-1));
+  }
+  setWindow(static_cast<std::size_t>(target));
+  return pos;
+}
+
+} // End namespace Avogadro
@@ -0,0 +1,57 @@
+/******************************************************************************
+  This source file is part of the Avogadro project.
+  This source code is released under the 3-Clause BSD License, (see "LICENSE").
+******************************************************************************/
+
+#ifndef AVOGADRO_MEMORYSTREAMBUF_H
+#define AVOGADRO_MEMORYSTREAMBUF_H
+
+#include <atomic>
+#include <streambuf>
+
+namespace Avogadro {
+
+/**
+ * @brief The MemoryStreamBuf class is a read only std::streambuf over a block
+ * of memory, usually a file mapped with QFile::map().
+ *
+ * The stream reads the memory in place, without copying it. It is exposed in
+ * windows of @a blockSize bytes so that, as with IODeviceStreamBuf, the cancel
+ * flag is checked and the byte counter is updated between windows. The memory
+ * must stay valid for the lifetime of the buffer.
+ */
+class MemoryStreamBuf : public std::streambuf
+{
+public:
+  MemoryStreamBuf(const char* data, std::size_t size,
+                  const std::atomic_bool* canceled = nullptr,
+                  std::atomic<long long>* bytes = nullptr,
+                  std::size_t blockSize = 1 << 20);
+
+  /**
+   * @return True if a read was refused because of the cancel flag.
+   */
+  bool wasCanceled() const { return m_wasCanceled; }
+
+protected:
+  int_type underflow() override;
+  std::streamsize showmanyc() override;
+  pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+                   std::ios_base::openmode which) override;
+  pos_type seekpos(pos_type pos, std::ios_base::openmode which) override;
+
+private:
+  char* m_data;
+  std::size_t m_size;
+  std::size_t m_blockSize;
+  const std::atomic_bool* m_canceled;
+  std::atomic<long long>* m_bytes;
+  bool m_wasCanceled;
+
+  /** Expose the window starting at @a pos. */
+  void setWindow(std::size_t pos);
+};
+
+} // End namespace Avogadro
+
+#endif // AVOGADRO_MEMORYSTREAMBUF_H
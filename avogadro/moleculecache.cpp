@@ -0,0 +1,306 @@
+/******************************************************************************
+  This source file is part of the Avogadro project.
+  This source code is released under the 3-Clause BSD License, (see "LICENSE").
+******************************************************************************/
+
+#include "moleculecache.h"
+
+#include <avogadro/core/molecule.h>
+#include <avogadro/io/cjsonformat.h>
+
+#include <QtConcurrent/QtConcurrentRun>
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QDataStream>
+#include <QtCore/QDateTime>
+#include <QtCore/QDebug>
+#include <QtCore/QDir>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QLoggingCategory>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QSaveFile>
+#include <QtCore/QStandardPaths>
+#include <QtCore/QThreadPool>
+
+#include <limits>
+#include <string>
+#include <vector>
+
+namespace Avogadro {
+
+namespace {
+// Enabled with QT_LOGGING_RULES="avogadro.io.cache.debug=true".
+Q_LOGGING_CATEGORY(lcCache, "avogadro.io.cache", QtWarningMsg)
+
+// "AVOM", followed by the version of the layout.
+const quint32 entryMagic = 0x41564f4d;
+const quint32 entryVersion = 2;
+
+QString entryPath(const QString& fileName, const QString& reader)
+{
+  QByteArray key = (fileName + '\n' + reader).toUtf8();
+  return MoleculeCache::cacheDirectory() + '/' +
+         QCryptographicHash::hash(key, QCryptographicHash::Sha1).toHex() +
+         ".avomol";
+}
+
+qint64 modificationTime(const QFileInfo& info)
+{
+  return info.lastModified().toMSecsSinceEpoch();
+}
+
+// Entries are only read back on the machine that wrote them, the arrays are
+// copied as they are in memory.
+bool writeFrames(QDataStream& stream,
+                 const std::vector<Core::Array<Vector3>>& frames)
+{
+  stream << static_cast<quint32>(frames.size());
+  for (const auto& frame : frames) {
+    qint64 bytes = static_cast<qint64>(frame.size() * sizeof(Vector3));
+    if (bytes > std::numeric_limits<int>::max())
+      return false;
+    stream << bytes;
+    stream.writeRawData(reinterpret_cast<const char*>(frame.data()),
+                        static_cast<int>(bytes));
+  }
+  return stream.status() == QDataStream::Ok;
+}
+
+bool readFrames(QDataStream& stream, size_t atomCount,
+                std::vector<Core::Array<Vector3>>& frames)
+{
+  quint32 count = 0;
+  stream >> count;
+  for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; ++i) {
+    qint64 bytes = -1;
+    stream >> bytes;
+    if (bytes != static_cast<qint64>(atomCount * sizeof(Vector3)))
+      return false;
+    Core::Array<Vector3> frame(atomCount);
+    if (stream.readRawData(reinterpret_cast<char*>(frame.data()),
+                           static_cast<int>(bytes)) != bytes) {
+      return false;
+    }
+    frames.push_back(frame);
+  }
+  return stream.status() == QDataStream::Ok && frames.size() == count;
+}
+} // namespace
+
+MoleculeCache::MoleculeCache()
+  : m_enabled(true)
+  , m_maximumSize(qint64(1) << 30)
+  , m_hits(0)
+  , m_misses(0)
+  , m_pool(nullptr)
+{
+}
+
+MoleculeCache& MoleculeCache::instance()
+{
+  static MoleculeCache cache;
+  return cache;
+}
+
+QString MoleculeCache::cacheDirectory()
+{
+  return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) +
+         "/molecules";
+}
+
+bool MoleculeCache::read(const QString& fileName, const QString& reader,
+                         Core::Molecule& molecule)
+{
+  if (!m_enabled)
+    return false;
+
+  QElapsedTimer timer;
+  timer.start();
+  QFileInfo info(fileName);
+  QString path = info.absoluteFilePath();
+  QFile file(entryPath(path, reader));
+  bool hit = false;
+  if (file.open(QIODevice::ReadOnly)) {
+    QDataStream stream(&file);
+    quint32 magic = 0;
+    quint32 version = 0;
+    stream >> magic >> version;
+    if (magic == entryMagic && version == entryVersion) {
+      QString entryFile;
+      QString entryReader;
+      qint64 size = -1;
+      qint64 modified = -1;
+      QByteArray data;
+      stream >> entryFile >> entryReader >> size >> modified >> data;
+
+      // The key is a hash, check what it stands for.
+      if (stream.status() == QDataStream::Ok && entryFile == path &&
+          entryReader == reader && size == info.size() &&
+          modified == modificationTime(info)) {
+        data = qUncompress(data);
+        Core::Molecule cached;
+        Io::CjsonFormat cjson;
+        std::vector<Core::Array<Vector3>> frames;
+        if (!data.isEmpty() &&
+            cjson.readString(std::string(data.constData(), data.size()),
+                             cached) &&
+            readFrames(stream, cached.atomCount(), frames)) {
+          for (const auto& frame : frames)
+            cached.setCoordinate3d(frame, cached.coordinate3dCount());
+          molecule = cached;
+          hit = true;
+        }
+      }
+    }
+  }
+
+  if (hit) {
+    ++m_hits;
+    // The eviction order.
+    file.setFileTime(QDateTime::currentDateTime(),
+                     QFileDevice::FileModificationTime);
+    qCDebug(lcCache).noquote() << QString("Molecule cache hit for %1 in %2 ms")
+                                    .arg(fileName)
+                                    .arg(timer.elapsed());
+  } else {
+    ++m_misses;
+  }
+  return hit;
+}
+
+void MoleculeCache::store(const QString& fileName, const QString& reader,
+                          const Core::Molecule& molecule)
+{
+  if (!m_enabled)
+    return;
+
+  // Reading CJSON again would not be any faster.
+  static const QString cjsonReader =
+    QString::fromStdString(Io::CjsonFormat().identifier());
+  if (reader == cjsonReader)
+    return;
+
+  // The caller may go on changing the molecule while the entry is written.
+  auto* copy = new Core::Molecule(molecule);
+  QString path = QFileInfo(fileName).absoluteFilePath();
+  QThreadPool* pool = m_pool.load();
+  QtConcurrent::run(pool ? pool : QThreadPool::globalInstance(),
+                    [this, path, reader, copy]() {
+                      write(path, reader, copy);
+                      delete copy;
+                    });
+}
+
+void MoleculeCache::setThreadPool(QThreadPool* pool)
+{
+  m_pool = pool;
+}
+
+QThreadPool* MoleculeCache::threadPool() const
+{
+  QThreadPool* pool = m_pool.load();
+  return pool ? pool : QThreadPool::globalInstance();
+}
+
+void MoleculeCache::write(const QString& fileName, const QString& reader,
+                          Core::Molecule* molecule)
+{
+  QFileInfo info(fileName);
+
+  // CJSON would write the frames as text, they are appended as they are.
+  std::vector<Core::Array<Vector3>> frames;
+  for (int i = 0; i < molecule->coordinate3dCount(); ++i)
+    frames.push_back(molecule->coordinate3d(i));
+  molecule->clearCoordinate3d();
+
+  std::string data;
+  Io::CjsonFormat cjson;
+  if (!cjson.writeString(data, *molecule) ||
+      data.size() > static_cast<size_t>(std::numeric_limits<int>::max()))
+    return;
+  QByteArray compressed =
+    qCompress(reinterpret_cast<const uchar*>(data.data()),
+              static_cast<int>(data.size()));
+  data.clear();
+
+  QMutexLocker locker(&m_mutex);
+  QDir().mkpath(cacheDirectory());
+  QSaveFile file(entryPath(fileName, reader));
+  if (!file.open(QIODevice::WriteOnly))
+    return;
+
+  QDataStream stream(&file);
+  stream << entryMagic << entryVersion << fileName << reader << info.size()
+         << modificationTime(info) << compressed;
+  if (!writeFrames(stream, frames) || !file.commit()) {
+    qWarning() << "Could not write the molecule cache entry for" << fileName;
+    return;
+  }
+  evict();
+}
+
+void MoleculeCache::evict()
+{
+  // Oldest first, entries are touched when they are used.
+  QDir dir(cacheDirectory());
+  QFileInfoList entries = dir.entryInfoList(
+    QStringList() << "*.avomol", QDir::Files, QDir::Time | QDir::Reversed);
+  qint64 total = 0;
+  foreach (const QFileInfo& entry, entries)
+    total += entry.size();
+
+  qint64 maximum = m_maximumSize.load();
+  for (int i = 0; i < entries.size() && total > maximum; ++i) {
+    if (QFile::remove(entries.at(i).absoluteFilePath()))
+      total -= entries.at(i).size();
+  }
+}
+
+void MoleculeCache::setEnabled(bool enabled)
+{
+  m_enabled = enabled;
+}
+
+bool MoleculeCache::isEnabled() const
+{
+  return m_enabled;
+}
+
+void MoleculeCache::setMaximumSize(qint64 bytes)
+{
+  m_maximumSize = bytes;
+}
+
+qint64 MoleculeCache::maximumSize() const
+{
+  return m_maximumSize.load();
+}
+
+qint64 MoleculeCache::size() const
+{
+  qint64 total = 0;
+  QDir dir(cacheDirectory());
+  foreach (const QFileInfo& entry,
+           dir.entryInfoList(QStringList() << "*.avomol", QDir::Files))
+    total += entry.size();
+  return total;
+}
+
+void MoleculeCache::clear()
+{
+  QMutexLocker locker(&m_mutex);
+  QDir(cacheDirectory()).removeRecursively();
+}
+
+int MoleculeCache::hits() const
+{
+  return m_hits.load();
+}
+
+int MoleculeCache::misses() const
+{
+  return m_misses.load();
+}
+
+} // End namespace Avogadro
@@ -0,0 +1,125 @@
+/******************************************************************************
+  This source file is part of the Avogadro project.
+  This source code is released under the 3-Clause BSD License, (see "LICENSE").
+******************************************************************************/
+
+#ifndef AVOGADRO_MOLECULECACHE_H
+#define AVOGADRO_MOLECULECACHE_H
+
+#include <QtCore/QMutex>
+#include <QtCore/QString>
+
+#include <atomic>
+
+class QThreadPool;
+
+namespace Avogadro {
+
+namespace Core {
+class Molecule;
+}
+
+/**
+ * @brief The MoleculeCache class keeps the molecules read from slow text
+ * formats, so that reopening the same file does not parse it again.
+ *
+ * Each entry is a binary file under QStandardPaths::CacheLocation. The
+ * coordinate sets of trajectories, which make up most of large entries, are
+ * stored as raw arrays of the native byte order. The rest of the molecule is
+ * kept as compressed CJSON, which keeps everything the readers produce.
+ * Entries are keyed on the absolute path of the file and the identifier of
+ * the reader, and are only used while the size and modification time of the
+ * file are unchanged. The least recently used entries are removed once the
+ * cache grows beyond maximumSize().
+ *
+ * All functions are thread safe, they are called from the I/O workers.
+ */
+class MoleculeCache
+{
+public:
+  static MoleculeCache& instance();
+
+  /**
+   * Read the entry for @a fileName and @a reader into @a molecule.
+   * @return True on a hit, @a molecule is unchanged otherwise.
+   */
+  bool read(const QString& fileName, const QString& reader,
+            Core::Molecule& molecule);
+
+  /**
+   * Add @a molecule, read from @a fileName with @a reader, to the cache. The
+   * entry is written in the background from a copy of the molecule, which
+   * can be used as soon as this returns.
+   */
+  void store(const QString& fileName, const QString& reader,
+             const Core::Molecule& molecule);
+
+  /**
+   * The pool the entries are written on, the global instance if not set.
+   * The pool must outlive the entries stored, or be unset first.
+   * @{
+   */
+  void setThreadPool(QThreadPool* pool);
+  QThreadPool* threadPool() const;
+  /**@}*/
+
+  /**
+   * Whether the cache is used, true by default.
+   * @{
+   */
+  void setEnabled(bool enabled);
+  bool isEnabled() const;
+  /**@}*/
+
+  /**
+   * The total size of the entries in bytes, 1 GiB by default. A smaller
+   * size takes effect when the next entry is stored.
+   * @{
+   */
+  void setMaximumSize(qint64 bytes);
+  qint64 maximumSize() const;
+  /**@}*/
+
+  /**
+   * @return The current total size of the entries in bytes.
+   */
+  qint64 size() const;
+
+  /**
+   * Remove all entries.
+   */
+  void clear();
+
+  /**
+   * The number of lookups that found, or did not find, a valid entry since
+   * the application started.
+   * @{
+   */
+  int hits() const;
+  int misses() const;
+  /**@}*/
+
+  /**
+   * @return The directory holding the entries.
+   */
+  static QString cacheDirectory();
+
+private:
+  MoleculeCache();
+
+  std::atomic_bool m_enabled;
+  std::atomic<long long> m_maximumSize;
+  std::atomic_int m_hits;
+  std::atomic_int m_misses;
+  std::atomic<QThreadPool*> m_pool;
+  // Serializes writing entries and evicting them.
+  QMutex m_mutex;
+
+  void write(const QString& fileName, const QString& reader,
+             Core::Molecule* molecule);
+  void evict();
+};
+
+} // End namespace Avogadro
+
+#endif // AVOGADRO_MOLECULECACHE_H
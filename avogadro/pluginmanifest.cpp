@@ -0,0 +1,269 @@
+/******************************************************************************
+  This source file is part of the Avogadro project.
+  This source code is released under the 3-Clause BSD License, (see "LICENSE").
+******************************************************************************/
+
+#include "pluginmanifest.h"
+#include "avogadroappconfig.h"
+
+#include <avogadro/qtplugins/pluginmanager.h>
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QDateTime>
+#include <QtCore/QDebug>
+#include <QtCore/QDir>
+#include <QtCore/QDirIterator>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QJsonDocument>
+#include <QtCore/QJsonObject>
+#include <QtCore/QLocale>
+#include <QtCore/QStandardPaths>
+#include <QtGui/QKeySequence>
+
+#include <QAction>
+
+namespace Avogadro {
+
+namespace {
+// Increment when the layout of the manifest changes.
+const int manifestVersion = 1;
+
+void appendFile(QJsonArray& files, const QFileInfo& info)
+{
+  QJsonObject file;
+  file["path"] = info.absoluteFilePath();
+  file["mtime"] = QString::number(info.lastModified().toMSecsSinceEpoch());
+  file["size"] = QString::number(info.size());
+  files.append(file);
+}
+
+void appendDirectory(QJsonArray& files, const QString& path)
+{
+  QDirIterator it(path, QDir::Files, QDirIterator::Subdirectories);
+  QStringList entries;
+  while (it.hasNext())
+    entries << it.next();
+  // Directory iteration order is not guaranteed, the key must be stable.
+  entries.sort();
+  foreach (const QString& entry, entries)
+    appendFile(files, QFileInfo(entry));
+}
+} // namespace
+
+PluginManifest::PluginManifest()
+  : m_valid(false)
+{
+}
+
+QString PluginManifest::cacheFileName()
+{
+  return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) +
+         "/plugin-manifest.json";
+}
+
+QJsonArray PluginManifest::fingerprint()
+{
+  QJsonArray files;
+
+  // Plugins may be linked into the executable or its libraries.
+  appendFile(files, QFileInfo(QCoreApplication::applicationFilePath()));
+
+  foreach (const QString& dir,
+           QtPlugins::PluginManager::instance()->pluginPath())
+    appendDirectory(files, dir);
+
+  // Script plugins create menu entries and commands from these directories,
+  // see MainWindow::addScript().
+  QStringList scriptTypes;
+  scriptTypes << "commands"
+              << "inputGenerators"
+              << "formatScripts"
+              << "charges"
+              << "energy"
+              << "other";
+  QStringList stdPaths =
+    QStandardPaths::standardLocations(QStandardPaths::AppLocalDataLocation);
+  foreach (const QString& dirStr, stdPaths)
+    foreach (const QString& type, scriptTypes)
+      appendDirectory(files, dirStr + '/' + type);
+
+  return files;
+}
+
+bool PluginManifest::load()
+{
+  clear();
+
+  QFile file(cacheFileName());
+  if (!file.open(QIODevice::ReadOnly))
+    return false;
+
+  QJsonObject root = QJsonDocument::fromJson(file.readAll()).object();
+  if (root["version"].toInt() != manifestVersion ||
+      root["application"].toString() != AvogadroApp_VERSION ||
+      root["locale"].toString() != QLocale().name() ||
+      root["fingerprint"].toArray() != fingerprint()) {
+    qDebug() << "Plugin manifest is out of date, rebuilding.";
+    return false;
+  }
+
+  foreach (const QJsonValue& value, root["tools"].toArray())
+    m_tools << value.toString();
+  foreach (const QJsonValue& value, root["scenes"].toArray())
+    m_scenes << value.toString();
+  foreach (const QJsonValue& value, root["extensions"].toArray())
+    m_extensions << fromJson(value.toObject());
+
+  m_valid = true;
+  return true;
+}
+
+bool PluginManifest::save()
+{
+  QJsonObject root;
+  root["version"] = manifestVersion;
+  root["application"] = QString(AvogadroApp_VERSION);
+  root["locale"] = QLocale().name();
+  root["fingerprint"] = fingerprint();
+  root["tools"] = QJsonArray::fromStringList(m_tools);
+  root["scenes"] = QJsonArray::fromStringList(m_scenes);
+
+  QJsonArray extensions;
+  foreach (const ExtensionEntry& entry, m_extensions)
+    extensions.append(toJson(entry));
+  root["extensions"] = extensions;
+
+  QFileInfo info(cacheFileName());
+  QDir().mkpath(info.absolutePath());
+  QFile file(info.absoluteFilePath());
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    qWarning() << "Cannot write the plugin manifest" << file.fileName();
+    return false;
+  }
+  file.write(QJsonDocument(root).toJson(QJsonDocument::Compact));
+  return true;
+}
+
+void PluginManifest::clear()
+{
+  m_extensions.clear();
+  m_tools.clear();
+  m_scenes.clear();
+  m_valid = false;
+}
+
+const PluginManifest::ExtensionEntry* PluginManifest::extension(
+  const QString& identifier) const
+{
+  foreach (const ExtensionEntry& entry, m_extensions) {
+    if (entry.identifier == identifier)
+      return &entry;
+  }
+  return nullptr;
+}
+
+void PluginManifest::setExtension(const ExtensionEntry& entry)
+{
+  for (auto& existing : m_extensions) {
+    if (existing.identifier == entry.identifier) {
+      existing = entry;
+      return;
+    }
+  }
+  m_extensions.append(entry);
+}
+
+void PluginManifest::setFileFormats(const QString& identifier,
+                                    const QStringList& formats)
+{
+  for (auto& existing : m_extensions) {
+    if (existing.identifier == identifier) {
+      foreach (const QString& format, formats) {
+        if (!existing.fileFormats.contains(format))
+          existing.fileFormats << format;
+      }
+      return;
+    }
+  }
+}
+
+PluginManifest::ActionEntry PluginManifest::actionEntry(
+  const QAction* action, const QStringList& path)
+{
+  ActionEntry entry;
+  entry.text = action->text();
+  entry.menuPath = path;
+  bool hasPriority;
+  int priority = action->property("menu priority").toInt(&hasPriority);
+  if (hasPriority)
+    entry.priority = priority;
+  entry.shortcut = action->shortcut().toString(QKeySequence::PortableText);
+  entry.iconName = action->icon().name();
+  entry.checkable = action->isCheckable();
+  entry.checked = action->isChecked();
+  return entry;
+}
+
+QJsonObject PluginManifest::toJson(const ExtensionEntry& entry)
+{
+  QJsonObject object;
+  object["identifier"] = entry.identifier;
+  object["description"] = entry.description;
+
+  QJsonArray actions;
+  foreach (const ActionEntry& action, entry.actions) {
+    QJsonObject actionObject;
+    actionObject["text"] = action.text;
+    actionObject["menuPath"] = QJsonArray::fromStringList(action.menuPath);
+    actionObject["priority"] = action.priority;
+    actionObject["shortcut"] = action.shortcut;
+    actionObject["icon"] = action.iconName;
+    actionObject["checkable"] = action.checkable;
+    actionObject["checked"] = action.checked;
+    actions.append(actionObject);
+  }
+  object["actions"] = actions;
+
+  QJsonObject commands;
+  for (auto it = entry.commands.constBegin(); it != entry.commands.constEnd();
+       ++it) {
+    commands[it.key()] = it.value();
+  }
+  object["commands"] = commands;
+  object["fileFormats"] = QJsonArray::fromStringList(entry.fileFormats);
+  return object;
+}
+
+PluginManifest::ExtensionEntry PluginManifest::fromJson(
+  const QJsonObject& object)
+{
+  ExtensionEntry entry;
+  entry.identifier = object["identifier"].toString();
+  entry.description = object["description"].toString();
+
+  foreach (const QJsonValue& value, object["actions"].toArray()) {
+    QJsonObject actionObject = value.toObject();
+    ActionEntry action;
+    action.text = actionObject["text"].toString();
+    foreach (const QJsonValue& pathValue,
+             actionObject["menuPath"].toArray())
+      action.menuPath << pathValue.toString();
+    action.priority = actionObject["priority"].toInt(-1);
+    action.shortcut = actionObject["shortcut"].toString();
+    action.iconName = actionObject["icon"].toString();
+    action.checkable = actionObject["checkable"].toBool();
+    action.checked = actionObject["checked"].toBool();
+    entry.actions << action;
+  }
+
+  QJsonObject commands = object["commands"].toObject();
+  foreach (const QString& command, commands.keys())
+    entry.commands.insert(command, commands[command].toString());
+
+  foreach (const QJsonValue& value, object["fileFormats"].toArray())
+    entry.fileFormats << value.toString();
+  return entry;
+}
+
+} // End namespace Avogadro
@@ -0,0 +1,138 @@
+/******************************************************************************
+  This source file is part of the Avogadro project.
+  This source code is released under the 3-Clause BSD License, (see "LICENSE").
+******************************************************************************/
+
+#ifndef AVOGADRO_PLUGINMANIFEST_H
+#define AVOGADRO_PLUGINMANIFEST_H
+
+#include <QtCore/QJsonArray>
+#include <QtCore/QList>
+#include <QtCore/QMap>
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+
+class QAction;
+class QJsonObject;
+
+namespace Avogadro {
+
+/**
+ * @brief The PluginManifest class is a persistent cache of plugin metadata.
+ *
+ * The manifest records, for every plugin factory, the factory type, its
+ * identifier and the information the main window needs to present the plugin
+ * without instantiating it: menu entries, registered script commands and the
+ * file formats it provides.
+ *
+ * The cache is stored under QStandardPaths::CacheLocation and is keyed on the
+ * path, modification time and size of every plugin library and plugin script,
+ * along with the application version and the user interface language. If any
+ * of these change the cached data is discarded and rebuilt from the live
+ * plugins.
+ */
+class PluginManifest
+{
+public:
+  /** A menu entry provided by an extension. */
+  struct ActionEntry
+  {
+    QString text;
+    QStringList menuPath;
+    int priority = -1;
+    QString shortcut;
+    QString iconName;
+    bool checkable = false;
+    bool checked = false;
+  };
+
+  /** Metadata for one ExtensionPluginFactory. */
+  struct ExtensionEntry
+  {
+    QString identifier;
+    QString description;
+    QList<ActionEntry> actions;
+    /** Script command mapped to its description. */
+    QMap<QString, QString> commands;
+    /** Identifiers of the file formats registered by the extension. */
+    QStringList fileFormats;
+  };
+
+  PluginManifest();
+
+  /**
+   * Read the cache from disk.
+   * @return True if the cache exists and matches the installed plugins.
+   */
+  bool load();
+
+  /**
+   * Write the cache to disk, keyed on the current plugin fingerprint.
+   */
+  bool save();
+
+  /**
+   * Discard all cached entries.
+   */
+  void clear();
+
+  /**
+   * @return True if the entries were read from a cache that matches the
+   * installed plugins.
+   */
+  bool isValid() const { return m_valid; }
+
+  /**
+   * The factory identifiers of the tool and scene plugins.
+   * @{
+   */
+  QStringList toolIdentifiers() const { return m_tools; }
+  void setToolIdentifiers(const QStringList& ids) { m_tools = ids; }
+  QStringList sceneIdentifiers() const { return m_scenes; }
+  void setSceneIdentifiers(const QStringList& ids) { m_scenes = ids; }
+  /**@}*/
+
+  /**
+   * The extension entries, in factory order.
+   * @{
+   */
+  const QList<ExtensionEntry>& extensions() const { return m_extensions; }
+  const ExtensionEntry* extension(const QString& identifier) const;
+  void setExtension(const ExtensionEntry& entry);
+  /**@}*/
+
+  /**
+   * Record the file formats provided by the extension @a identifier.
+   */
+  void setFileFormats(const QString& identifier, const QStringList& formats);
+
+  /**
+   * Convenience function to describe @a action added at @a path.
+   */
+  static ActionEntry actionEntry(const QAction* action,
+                                 const QStringList& path);
+
+  /**
+   * The file used to store the manifest.
+   */
+  static QString cacheFileName();
+
+private:
+  QList<ExtensionEntry> m_extensions;
+  QStringList m_tools;
+  QStringList m_scenes;
+  bool m_valid;
+
+  /**
+   * Build the key for the installed plugins: each plugin library and script
+   * with its modification time and size.
+   */
+  static QJsonArray fingerprint();
+
+  static QJsonObject toJson(const ExtensionEntry& entry);
+  static ExtensionEntry fromJson(const QJsonObject& object);
+};
+
+} // End namespace Avogadro
+
+#endif // AVOGADRO_PLUGINMANIFEST_H
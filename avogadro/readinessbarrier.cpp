@@ -0,0 +1,83 @@
+/******************************************************************************
+  This source file is part of the Avogadro project.
+  This source code is released under the 3-Clause BSD License, (see "LICENSE").
+******************************************************************************/
+
+#include "readinessbarrier.h"
+
+#include <QtCore/QDebug>
+#include <QtCore/QTimer>
+
+namespace Avogadro {
+
+ReadinessBarrier::ReadinessBarrier(QObject* parent)
+  : QObject(parent)
+  , m_watchdog(new QTimer(this))
+  , m_firstMolecule(-1)
+  , m_started(false)
+  , m_ready(false)
+{
+  m_timer.start();
+  m_watchdog->setSingleShot(true);
+  connect(m_watchdog, &QTimer::timeout, this, &ReadinessBarrier::timedOut);
+}
+
+ReadinessBarrier::~ReadinessBarrier() = default;
+
+void ReadinessBarrier::addPending(const QString& name)
+{
+  if (!m_ready)
+    m_pending.insert(name);
+}
+
+void ReadinessBarrier::markReady(const QString& name)
+{
+  if (m_pending.remove(name))
+    checkReady();
+}
+
+void ReadinessBarrier::start(int timeout)
+{
+  if (m_started)
+    return;
+  m_started = true;
+  m_watchdog->start(timeout);
+  // Always emit from the event loop, so receivers see a consistent order.
+  QTimer::singleShot(0, this, &ReadinessBarrier::checkReady);
+}
+
+QStringList ReadinessBarrier::pending() const
+{
+  QStringList names = m_pending.values();
+  names.sort();
+  return names;
+}
+
+bool ReadinessBarrier::moleculeLoaded()
+{
+  if (m_firstMolecule >= 0)
+    return false;
+  m_firstMolecule = m_timer.elapsed();
+  return true;
+}
+
+void ReadinessBarrier::timedOut()
+{
+  if (m_ready)
+    return;
+  qWarning() << "Still waiting for file formats from" << pending()
+             << "after" << m_timer.elapsed() << "ms, continuing without them.";
+  m_pending.clear();
+  checkReady();
+}
+
+void ReadinessBarrier::checkReady()
+{
+  if (!m_started || m_ready || !m_pending.isEmpty())
+    return;
+  m_ready = true;
+  m_watchdog->stop();
+  emit ready();
+}
+
+} // End namespace Avogadro
@@ -0,0 +1,103 @@
+/******************************************************************************
+  This source file is part of the Avogadro project.
+  This source code is released under the 3-Clause BSD License, (see "LICENSE").
+******************************************************************************/
+
+#ifndef AVOGADRO_READINESSBARRIER_H
+#define AVOGADRO_READINESSBARRIER_H
+
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QObject>
+#include <QtCore/QSet>
+#include <QtCore/QStringList>
+
+class QTimer;
+
+namespace Avogadro {
+
+/**
+ * @brief The ReadinessBarrier class tracks the plugins that still have to
+ * register their file formats during start up.
+ *
+ * Each plugin expected to provide formats is added with addPending(), and
+ * removed with markReady() when its formats arrive. Once start() was called
+ * and nothing is pending the ready() signal is emitted. A watchdog releases
+ * the barrier if a plugin never reports, so start up can not stall on it.
+ *
+ * The barrier also records the time from its creation to the first molecule
+ * being shown, which is the delay the user actually notices.
+ */
+class ReadinessBarrier : public QObject
+{
+  Q_OBJECT
+
+public:
+  explicit ReadinessBarrier(QObject* parent = nullptr);
+  ~ReadinessBarrier() override;
+
+  /**
+   * Wait for the plugin @a name before becoming ready.
+   */
+  void addPending(const QString& name);
+
+  /**
+   * The plugin @a name has registered its formats.
+   */
+  void markReady(const QString& name);
+
+  /**
+   * All plugins have been added, emit ready() once none are pending or after
+   * @a timeout milliseconds, whichever comes first.
+   */
+  void start(int timeout);
+
+  /**
+   * @return True once the barrier was released.
+   */
+  bool isReady() const { return m_ready; }
+
+  /**
+   * @return True if @a name is still pending.
+   */
+  bool isPending(const QString& name) const { return m_pending.contains(name); }
+
+  /**
+   * @return The plugins that have not reported yet.
+   */
+  QStringList pending() const;
+
+  /**
+   * Record that a molecule was shown.
+   * @return True for the first molecule only.
+   */
+  bool moleculeLoaded();
+
+  /**
+   * @return The time to the first molecule in milliseconds, or -1 if no
+   * molecule was loaded yet.
+   */
+  qint64 timeToFirstMolecule() const { return m_firstMolecule; }
+
+signals:
+  /**
+   * Emitted once, when no plugins are pending or the watchdog expired.
+   */
+  void ready();
+
+private slots:
+  void timedOut();
+
+private:
+  QSet<QString> m_pending;
+  QElapsedTimer m_timer;
+  QTimer* m_watchdog;
+  qint64 m_firstMolecule;
+  bool m_started;
+  bool m_ready;
+
+  void checkReady();
+};
+
+} // End namespace Avogadro
+
+#endif // AVOGADRO_READINESSBARRIER_H
@@ -0,0 +1,165 @@
+/******************************************************************************
+  This source file is part of the Avogadro project.
+  This source code is released under the 3-Clause BSD License, (see "LICENSE").
+******************************************************************************/
+
+#include "recordindex.h"
+
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+
+namespace Avogadro {
+
+namespace {
+bool isBlank(const QByteArray& line)
+{
+  return line.trimmed().isEmpty();
+}
+
+bool scanXyz(QIODevice& device, const RecordIndex::Visitor& visitor)
+{
+  while (!device.atEnd()) {
+    qint64 start = device.pos();
+    QByteArray line = device.readLine();
+    if (isBlank(line))
+      continue;
+
+    bool ok = false;
+    int atomCount = line.trimmed().toInt(&ok);
+    if (!ok || atomCount < 0)
+      return false;
+
+    // The comment line, then one line per atom.
+    QByteArray data = line;
+    for (int i = 0; i <= atomCount; ++i) {
+      if (device.atEnd())
+        return false;
+      data += device.readLine();
+    }
+    if (!visitor({ start, data.size() }, data))
+      return true;
+  }
+  return true;
+}
+
+bool scanSdf(QIODevice& device, const RecordIndex::Visitor& visitor)
+{
+  qint64 start = device.pos();
+  QByteArray data;
+  while (!device.atEnd()) {
+    QByteArray line = device.readLine();
+    data += line;
+    if (line.startsWith("$$$$")) {
+      if (!visitor({ start, data.size() }, data))
+        return true;
+      data.clear();
+      start = device.pos();
+    }
+  }
+
+  // The terminator is optional after the last record.
+  if (!isBlank(data))
+    visitor({ start, data.size() }, data);
+  return true;
+}
+
+bool scanPdb(QIODevice& device, const RecordIndex::Visitor& visitor)
+{
+  qint64 start = device.pos();
+  QByteArray data;
+  bool inModel = false;
+  bool hasModels = false;
+  while (!device.atEnd()) {
+    QByteArray line = device.readLine();
+    if (line.startsWith("MODEL")) {
+      if (inModel)
+        return false;
+      inModel = true;
+      // The header stays with the first model, later ones start here.
+      if (hasModels) {
+        data.clear();
+        start = device.pos() - line.size();
+      }
+    }
+    data += line;
+    if (line.startsWith("ENDMDL")) {
+      if (!inModel)
+        return false;
+      inModel = false;
+      hasModels = true;
+      if (!visitor({ start, data.size() }, data))
+        return true;
+      data.clear();
+      start = device.pos();
+    }
+  }
+  if (inModel)
+    return false;
+
+  // Without MODEL records the whole file is a single structure.
+  if (!hasModels && !isBlank(data))
+    visitor({ start, data.size() }, data);
+  return true;
+}
+} // namespace
+
+RecordIndex::RecordIndex()
+  : m_layout(Unknown)
+{
+}
+
+RecordIndex::Layout RecordIndex::layoutForFile(const QString& fileName)
+{
+  QString suffix = QFileInfo(fileName).suffix().toLower();
+  if (suffix == "xyz")
+    return Xyz;
+  if (suffix == "sdf" || suffix == "sd")
+    return Sdf;
+  if (suffix == "pdb" || suffix == "ent")
+    return Pdb;
+  return Unknown;
+}
+
+bool RecordIndex::scan(QIODevice& device, Layout layout,
+                       const Visitor& visitor)
+{
+  switch (layout) {
+    case Xyz:
+      return scanXyz(device, visitor);
+    case Sdf:
+      return scanSdf(device, visitor);
+    case Pdb:
+      return scanPdb(device, visitor);
+    default:
+      return false;
+  }
+}
+
+bool RecordIndex::build(const QString& fileName, Layout layout)
+{
+  m_fileName = fileName;
+  m_layout = layout == Unknown ? layoutForFile(fileName) : layout;
+  m_records.clear();
+
+  QFile file(fileName);
+  if (m_layout == Unknown || !file.open(QIODevice::ReadOnly))
+    return false;
+
+  return scan(file, m_layout, [this](const Record& record, const QByteArray&) {
+    m_records.append(record);
+    return true;
+  });
+}
+
+QByteArray RecordIndex::read(QIODevice& device, int index) const
+{
+  if (index < 0 || index >= m_records.size())
+    return QByteArray();
+
+  const Record& entry = m_records.at(index);
+  if (!device.seek(entry.offset))
+    return QByteArray();
+  return device.read(entry.length);
+}
+
+} // End namespace Avogadro
@@ -0,0 +1,94 @@
+/******************************************************************************
+  This source file is part of the Avogadro project.
+  This source code is released under the 3-Clause BSD License, (see "LICENSE").
+******************************************************************************/
+
+#ifndef AVOGADRO_RECORDINDEX_H
+#define AVOGADRO_RECORDINDEX_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QList>
+#include <QtCore/QString>
+
+#include <functional>
+
+class QIODevice;
+
+namespace Avogadro {
+
+/**
+ * @brief The RecordIndex class finds the byte ranges of the records in files
+ * holding several frames or molecules one after the other.
+ *
+ * Records are delimited with a single sequential pass over the file, without
+ * parsing them: XYZ records start with an atom count line, SDF records end
+ * with a "$$$$" line and PDB records are MODEL ... ENDMDL blocks. A record can
+ * then be read on its own and handed to the matching Io::FileFormat.
+ */
+class RecordIndex
+{
+public:
+  enum Layout
+  {
+    Unknown,
+    Xyz,
+    Sdf,
+    Pdb
+  };
+
+  struct Record
+  {
+    qint64 offset;
+    qint64 length;
+  };
+
+  /**
+   * Called by scan() with each record and its contents. Return false to stop
+   * the scan.
+   */
+  typedef std::function<bool(const Record&, const QByteArray&)> Visitor;
+
+  RecordIndex();
+
+  /**
+   * @return The layout of @a fileName, guessed from its extension.
+   */
+  static Layout layoutForFile(const QString& fileName);
+
+  /**
+   * Read @a device from its current position to the end, calling @a visitor
+   * for each record of @a layout as soon as it is complete.
+   * @return False if the data does not match the layout, records before the
+   * mismatch have already been visited. A scan stopped by the visitor
+   * returns true.
+   */
+  static bool scan(QIODevice& device, Layout layout, const Visitor& visitor);
+
+  /**
+   * Index the records of @a fileName. If @a layout is Unknown it is guessed
+   * from the file name.
+   * @return True if the file could be read and matches the layout.
+   */
+  bool build(const QString& fileName, Layout layout = Unknown);
+
+  /**
+   * Read the record @a index from @a device, which must hold the indexed
+   * file.
+   */
+  QByteArray read(QIODevice& device, int index) const;
+
+  Layout layout() const { return m_layout; }
+  QString fileName() const { return m_fileName; }
+  int size() const { return m_records.size(); }
+  Record record(int index) const { return m_records.at(index); }
+  const QList<Record>& records() const { return m_records; }
+
+private:
+  QString m_fileName;
+  Layout m_layout;
+  QList<Record> m_records;
+};
+
+} // End namespace Avogadro
+
+#endif // AVOGADRO_RECORDINDEX_H
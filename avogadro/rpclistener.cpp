@@ -9,6 +9,7 @@
 #include <QtWidgets/QApplication>
 #include <QtWidgets/QInputDialog>
 
+#include <QtCore/QFileInfo>
 #include <QtCore/QJsonValue>
 #include <QtCore/QTimer>
 
@@ -173,6 +174,26 @@ void RpcListener::messageReceived(const MoleQueue::Message& message)
           .arg(QString::fromStdString(FileFormatManager::instance().error())));
       errorMessage.send();
     }
+  } else if (method == "queueFile") {
+    // Queue the supplied file to be read in the background, so the caller,
+    // e.g. a second instance handing over its files, can return at once.
+    // Read errors are shown by the window, not returned.
+    QString fileName = params["fileName"].toString();
+    if (QFileInfo(fileName).isFile()) {
+      m_window->openFiles(QStringList() << fileName);
+
+      // set response
+      MoleQueue::Message response = message.generateResponse();
+      response.setResult(true);
+      response.send();
+    } else {
+      // send error response
+      MoleQueue::Message errorMessage = message.generateErrorResponse();
+      errorMessage.setErrorCode(-1);
+      errorMessage.setErrorMessage(
+        QString("No such file: %1").arg(fileName));
+      errorMessage.send();
+    }
   } else if (method == "saveGraphic") {
     // Read the supplied file.
     QString fileName = params["fileName"].toString();
@@ -0,0 +1,104 @@
+/******************************************************************************
+  This source file is part of the Avogadro project.
+  This source code is released under the 3-Clause BSD License, (see "LICENSE").
+******************************************************************************/
+
+#include "shadercache.h"
+
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QDebug>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QSettings>
+#include <QtCore/QStandardPaths>
+#include <QtGui/QOpenGLContext>
+#include <QtGui/QOpenGLFunctions>
+
+namespace Avogadro {
+
+namespace {
+void setCacheVariable(const char* name, const QByteArray& value)
+{
+  // Leave any cache location chosen by the user alone.
+  if (!qEnvironmentVariableIsSet(name))
+    qputenv(name, value);
+}
+
+QString glString(QOpenGLFunctions* functions, GLenum name)
+{
+  return QString::fromLatin1(
+    reinterpret_cast<const char*>(functions->glGetString(name)));
+}
+} // namespace
+
+ShaderCache::ShaderCache()
+  : m_settingsEnabled(true)
+{
+}
+
+ShaderCache& ShaderCache::instance()
+{
+  static ShaderCache cache;
+  return cache;
+}
+
+QString ShaderCache::cacheDirectory()
+{
+  return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) +
+         "/shaders";
+}
+
+void ShaderCache::configure(bool clearCache)
+{
+  if (clearCache ||
+      (m_settingsEnabled &&
+       QSettings().value("shaderCache/stale", false).toBool())) {
+    clear();
+  }
+
+  QString path = QDir::toNativeSeparators(cacheDirectory());
+  QDir().mkpath(path);
+  QByteArray nativePath = QFile::encodeName(path);
+
+  // Mesa, current and older releases.
+  setCacheVariable("MESA_SHADER_CACHE_DIR", nativePath);
+  setCacheVariable("MESA_GLSL_CACHE_DIR", nativePath);
+  // NVIDIA
+  setCacheVariable("__GL_SHADER_DISK_CACHE", "1");
+  setCacheVariable("__GL_SHADER_DISK_CACHE_PATH", nativePath);
+  setCacheVariable("__GL_SHADER_DISK_CACHE_SKIP_CLEANUP", "1");
+}
+
+void ShaderCache::setDriver(QOpenGLContext* context)
+{
+  if (!m_settingsEnabled || !context || !context->functions())
+    return;
+
+  QOpenGLFunctions* functions = context->functions();
+  QString driver = glString(functions, GL_VENDOR) + '\n' +
+                   glString(functions, GL_RENDERER) + '\n' +
+                   glString(functions, GL_VERSION);
+  QString key =
+    QCryptographicHash::hash(driver.toUtf8(), QCryptographicHash::Sha1)
+      .toHex();
+
+  // The programs for this launch are already being read from the directory,
+  // so a changed driver only takes effect at the next launch.
+  QSettings settings;
+  QString previous = settings.value("shaderCache/driver").toString();
+  if (!previous.isEmpty() && previous != key) {
+    qDebug() << "OpenGL driver changed, the shader cache will be rebuilt.";
+    settings.setValue("shaderCache/stale", true);
+  }
+  settings.setValue("shaderCache/driver", key);
+}
+
+void ShaderCache::clear()
+{
+  QDir(cacheDirectory()).removeRecursively();
+
+  if (m_settingsEnabled)
+    QSettings().remove("shaderCache/stale");
+}
+
+} // End namespace Avogadro
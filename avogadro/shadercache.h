@@ -0,0 +1,74 @@
+/******************************************************************************
+  This source file is part of the Avogadro project.
+  This source code is released under the 3-Clause BSD License, (see "LICENSE").
+******************************************************************************/
+
+#ifndef AVOGADRO_SHADERCACHE_H
+#define AVOGADRO_SHADERCACHE_H
+
+#include <QtCore/QString>
+
+class QOpenGLContext;
+
+namespace Avogadro {
+
+/**
+ * @brief The ShaderCache class keeps the on-disk shader caches of the OpenGL
+ * drivers with the application.
+ *
+ * The shader programs are compiled inside AvogadroLibs, out of reach of
+ * glGetProgramBinary(), so the application does not store program binaries
+ * itself. It only relocates the program caches the drivers already keep
+ * (Mesa, including llvmpipe, and NVIDIA) to a directory under
+ * QStandardPaths::CacheLocation, so they can be cleared with the rest of the
+ * application data. The drivers key each entry on a hash of the shader
+ * sources and their own build. The vendor, renderer and version of the
+ * context are recorded as well, and the directory is emptied when they
+ * change.
+ */
+class ShaderCache
+{
+public:
+  static ShaderCache& instance();
+
+  /**
+   * Point the driver caches at cacheDirectory(). This must be called before
+   * the first OpenGL context is created. If @a clear is true, or the driver
+   * changed since the last launch, the cache is emptied first.
+   */
+  void configure(bool clear = false);
+
+  /**
+   * Record the driver of @a context, which must be current.
+   */
+  void setDriver(QOpenGLContext* context);
+
+  /**
+   * Remove all cached programs.
+   */
+  void clear();
+
+  /**
+   * Whether the driver is recorded in the settings, true by default. Turned
+   * off by --disable-settings, the cache is then not emptied for a changed
+   * driver either.
+   * @{
+   */
+  void setSettingsEnabled(bool enabled) { m_settingsEnabled = enabled; }
+  bool settingsEnabled() const { return m_settingsEnabled; }
+  /**@}*/
+
+  /**
+   * @return The directory holding the cached programs.
+   */
+  static QString cacheDirectory();
+
+private:
+  ShaderCache();
+
+  bool m_settingsEnabled;
+};
+
+} // End namespace Avogadro
+
+#endif // AVOGADRO_SHADERCACHE_H
@@ -0,0 +1,170 @@
+/******************************************************************************
+  This source file is part of the Avogadro project.
+  This source code is released under the 3-Clause BSD License, (see "LICENSE").
+******************************************************************************/
+
+#include "startupprofiler.h"
+#include "avogadroappconfig.h"
+
+#include <QtCore/QDebug>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QJsonArray>
+#include <QtCore/QJsonDocument>
+#include <QtCore/QJsonObject>
+#include <QtCore/QSysInfo>
+
+namespace Avogadro {
+
+namespace {
+double toMSecs(qint64 nsecs)
+{
+  return static_cast<double>(nsecs) / 1.0e6;
+}
+} // namespace
+
+StartupProfiler::Scope::Scope(const QString& name, const QString& category)
+  : m_name(name)
+{
+  StartupProfiler::instance().begin(m_name, category);
+}
+
+StartupProfiler::Scope::~Scope()
+{
+  StartupProfiler::instance().end(m_name);
+}
+
+StartupProfiler::StartupProfiler()
+  : m_outputFile("avogadro2-startup.json")
+  , m_depth(0)
+  , m_enabled(false)
+  , m_finished(false)
+{
+  m_timer.start();
+}
+
+StartupProfiler& StartupProfiler::instance()
+{
+  static StartupProfiler profiler;
+  return profiler;
+}
+
+double StartupProfiler::elapsed() const
+{
+  return toMSecs(m_timer.nsecsElapsed());
+}
+
+void StartupProfiler::begin(const QString& name, const QString& category)
+{
+  if (!m_enabled || m_finished)
+    return;
+
+  Entry entry;
+  entry.name = name;
+  entry.category = category;
+  entry.start = m_timer.nsecsElapsed();
+  entry.end = -1;
+  entry.depth = m_depth++;
+  m_entries.append(entry);
+}
+
+void StartupProfiler::end(const QString& name)
+{
+  if (!m_enabled || m_finished)
+    return;
+
+  qint64 now = m_timer.nsecsElapsed();
+  for (int i = m_entries.size() - 1; i >= 0; --i) {
+    Entry& entry = m_entries[i];
+    if (entry.end < 0 && entry.name == name) {
+      entry.end = now;
+      m_depth = entry.depth;
+      return;
+    }
+  }
+}
+
+void StartupProfiler::mark(const QString& name, const QString& category)
+{
+  if (!m_enabled || m_finished)
+    return;
+
+  Entry entry;
+  entry.name = name;
+  entry.category = category;
+  entry.start = entry.end = m_timer.nsecsElapsed();
+  entry.depth = m_depth;
+  m_entries.append(entry);
+}
+
+void StartupProfiler::finish()
+{
+  if (!m_enabled || m_finished)
+    return;
+
+  mark(QStringLiteral("startup complete"));
+  m_finished = true;
+
+  // Close anything left open, e.g. an early return from a phase.
+  qint64 now = m_timer.nsecsElapsed();
+  for (auto& entry : m_entries) {
+    if (entry.end < 0)
+      entry.end = now;
+  }
+
+  printTable();
+  writeJson();
+}
+
+void StartupProfiler::printTable() const
+{
+  qInfo().noquote() << QString("%1 %2 %3 %4")
+                         .arg("Phase", -48)
+                         .arg("Category", -12)
+                         .arg("Start (ms)", 12)
+                         .arg("Time (ms)", 12);
+  foreach (const Entry& entry, m_entries) {
+    QString name = QString(entry.depth * 2, ' ') + entry.name;
+    QString duration = entry.end > entry.start
+                         ? QString::number(toMSecs(entry.end - entry.start),
+                                           'f', 2)
+                         : QString();
+    qInfo().noquote() << QString("%1 %2 %3 %4")
+                           .arg(name, -48)
+                           .arg(entry.category, -12)
+                           .arg(toMSecs(entry.start), 12, 'f', 2)
+                           .arg(duration, 12);
+  }
+}
+
+void StartupProfiler::writeJson() const
+{
+  QJsonObject root;
+  root["application"] = QString(AvogadroApp_VERSION);
+  root["qt"] = QString(qVersion());
+  root["platform"] = QSysInfo::prettyProductName();
+  root["total"] = toMSecs(m_entries.isEmpty() ? 0 : m_entries.last().end);
+
+  QJsonArray phases;
+  foreach (const Entry& entry, m_entries) {
+    QJsonObject phase;
+    phase["name"] = entry.name;
+    phase["category"] = entry.category;
+    phase["depth"] = entry.depth;
+    phase["start"] = toMSecs(entry.start);
+    phase["duration"] = toMSecs(entry.end - entry.start);
+    phases.append(phase);
+  }
+  root["phases"] = phases;
+
+  QFile file(m_outputFile);
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    qWarning() << "Cannot write the startup profile" << m_outputFile;
+    return;
+  }
+  file.write(QJsonDocument(root).toJson());
+  qInfo().noquote() << "Startup profile written to"
+                    << QFileInfo(file).absoluteFilePath();
+}
+
+} // End namespace Avogadro
@@ -0,0 +1,114 @@
+/******************************************************************************
+  This source file is part of the Avogadro project.
+  This source code is released under the 3-Clause BSD License, (see "LICENSE").
+******************************************************************************/
+
+#ifndef AVOGADRO_STARTUPPROFILER_H
+#define AVOGADRO_STARTUPPROFILER_H
+
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QList>
+#include <QtCore/QString>
+
+namespace Avogadro {
+
+/**
+ * @brief The StartupProfiler class records monotonic timestamps for the phases
+ * of application start up.
+ *
+ * The profiler is enabled with the --profile-startup command line switch. Once
+ * the first frame has been drawn and the deferred "idle" phases have run,
+ * finish() prints a table of the recorded phases and writes them to a JSON
+ * file, which can be compared between builds and plugin sets. When disabled,
+ * all calls return immediately.
+ */
+class StartupProfiler
+{
+public:
+  /**
+   * @brief Begins a phase on construction and ends it on destruction.
+   */
+  class Scope
+  {
+  public:
+    explicit Scope(const QString& name,
+                   const QString& category = QStringLiteral("phase"));
+    ~Scope();
+
+  private:
+    QString m_name;
+  };
+
+  static StartupProfiler& instance();
+
+  /**
+   * Enable or disable recording. The clock starts when instance() is first
+   * called, regardless of this setting.
+   * @{
+   */
+  void setEnabled(bool enable) { m_enabled = enable; }
+  bool isEnabled() const { return m_enabled; }
+  /**@}*/
+
+  /**
+   * The JSON file written by finish().
+   * @{
+   */
+  void setOutputFile(const QString& fileName) { m_outputFile = fileName; }
+  QString outputFile() const { return m_outputFile; }
+  /**@}*/
+
+  /**
+   * Start the phase @a name, phases may be nested.
+   */
+  void begin(const QString& name,
+             const QString& category = QStringLiteral("phase"));
+
+  /**
+   * End the most recent phase called @a name.
+   */
+  void end(const QString& name);
+
+  /**
+   * Record an instantaneous event.
+   */
+  void mark(const QString& name,
+            const QString& category = QStringLiteral("event"));
+
+  /**
+   * Print the table and write the JSON file. Only the first call has an
+   * effect, later phases are ignored.
+   */
+  void finish();
+
+  /**
+   * @return Time since the profiler was created, in milliseconds.
+   */
+  double elapsed() const;
+
+private:
+  StartupProfiler();
+
+  struct Entry
+  {
+    QString name;
+    QString category;
+    qint64 start;
+    qint64 end;
+    int depth;
+  };
+
+  QElapsedTimer m_timer;
+  QList<Entry> m_entries;
+  QString m_outputFile;
+  int m_depth;
+  bool m_enabled;
+  bool m_finished;
+
+  void writeJson() const;
+  void printTable() const;
+};
+
+} // End namespace Avogadro
+
+#endif // AVOGADRO_STARTUPPROFILER_H
@@ -32,6 +32,8 @@ QStringList ViewFactory::views() const
 
 QWidget* ViewFactory::createView(const QString& view)
 {
+  // New views share the global context set up in main(), so they reuse the
+  // compiled shader programs rather than building their own.
   if (view == QObject::tr("3D View"))
     return new QtOpenGL::GLWidget;
 #ifdef AVO_USE_VTK
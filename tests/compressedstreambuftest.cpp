@@ -0,0 +1,315 @@
+/******************************************************************************
+  This source file is part of the Avogadro project.
+  This source code is released under the 3-Clause BSD License, (see "LICENSE").
+******************************************************************************/
+
+#include "compressedstreambuf.h"
+#include "iodevicestreambuf.h"
+
+#include <QtCore/QBuffer>
+#include <QtTest/QtTest>
+
+#include <istream>
+#include <ostream>
+#include <sstream>
+#include <string>
+
+using Avogadro::CompressedStreamBuf;
+using Avogadro::IODeviceStreamBuf;
+
+Q_DECLARE_METATYPE(CompressedStreamBuf::Codec)
+
+namespace {
+// Coordinates from a fixed sequence: compressible like real files, but not
+// so much that the compressed data fits in one read.
+QByteArray testData()
+{
+  QByteArray data;
+  quint32 seed = 1;
+  auto coordinate = [&seed]() {
+    seed = seed * 1664525u + 1013904223u;
+    return QByteArray::number((seed >> 8) / double(1 << 24) * 20.0 - 10.0, 'f',
+                              5);
+  };
+  while (data.size() < 1 << 20) {
+    data += "C " + coordinate() + " " + coordinate() + " " + coordinate() +
+            "\n";
+  }
+  return data;
+}
+
+QByteArray compress(const QByteArray& data, CompressedStreamBuf::Codec codec)
+{
+  std::stringbuf output;
+  CompressedStreamBuf buffer(&output, codec, std::ios_base::out);
+  std::ostream stream(&buffer);
+  stream.write(data.constData(), data.size());
+  stream.flush();
+  if (!buffer.finish() || !stream.good())
+    return QByteArray();
+  return QByteArray::fromStdString(output.str());
+}
+
+/** Decompress @a data, @a valid is set to CompressedStreamBuf::isValid(). */
+QByteArray decompress(const QByteArray& data, CompressedStreamBuf::Codec codec,
+                      bool& valid)
+{
+  std::stringbuf input(data.toStdString());
+  CompressedStreamBuf buffer(&input, codec, std::ios_base::in);
+  std::istream stream(&buffer);
+  std::string result((std::istreambuf_iterator<char>(stream)),
+                     std::istreambuf_iterator<char>());
+  valid = buffer.isValid();
+  return QByteArray::fromStdString(result);
+}
+} // namespace
+
+class CompressedStreamBufTest : public QObject
+{
+  Q_OBJECT
+
+private slots:
+  void detect_data();
+  void detect();
+  void fileNames_data();
+  void fileNames();
+
+  void roundTrip_data();
+  void roundTrip();
+  void concatenated_data();
+  void concatenated();
+  void truncated_data();
+  void truncated();
+  void cancel_data();
+  void cancel();
+  void seek_data();
+  void seek();
+
+  void unsupported();
+
+private:
+  static void addCodecs();
+};
+
+void CompressedStreamBufTest::detect_data()
+{
+  QTest::addColumn<QByteArray>("data");
+  QTest::addColumn<CompressedStreamBuf::Codec>("codec");
+
+  QTest::newRow("gzip") << QByteArray("\x1f\x8b\x08\x00", 4)
+                        << CompressedStreamBuf::Gzip;
+  QTest::newRow("zstd") << QByteArray("\x28\xb5\x2f\xfd\x00", 5)
+                        << CompressedStreamBuf::Zstd;
+  QTest::newRow("xz") << QByteArray("\xfd\x37\x7a\x58\x5a\x00", 6)
+                      << CompressedStreamBuf::Xz;
+  QTest::newRow("short xz") << QByteArray("\xfd\x37\x7a\x58\x5a", 5)
+                            << CompressedStreamBuf::None;
+  QTest::newRow("text") << QByteArray("3\nwater\n")
+                        << CompressedStreamBuf::None;
+  QTest::newRow("empty") << QByteArray() << CompressedStreamBuf::None;
+}
+
+void CompressedStreamBufTest::detect()
+{
+  QFETCH(QByteArray, data);
+  QFETCH(CompressedStreamBuf::Codec, codec);
+  QCOMPARE(CompressedStreamBuf::detect(data.constData(), data.size()), codec);
+}
+
+void CompressedStreamBufTest::fileNames_data()
+{
+  QTest::addColumn<QString>("fileName");
+  QTest::addColumn<CompressedStreamBuf::Codec>("codec");
+  QTest::addColumn<QString>("baseName");
+
+  QTest::newRow("gzip") << "traj.xyz.gz" << CompressedStreamBuf::Gzip
+                        << "traj.xyz";
+  QTest::newRow("zstd") << "water.cjson.ZST" << CompressedStreamBuf::Zstd
+                        << "water.cjson";
+  QTest::newRow("xz") << "/tmp/a.b/c.sdf.xz" << CompressedStreamBuf::Xz
+                      << "/tmp/a.b/c.sdf";
+  QTest::newRow("plain") << "water.cjson" << CompressedStreamBuf::None
+                         << "water.cjson";
+}
+
+void CompressedStreamBufTest::fileNames()
+{
+  QFETCH(QString, fileName);
+  QFETCH(CompressedStreamBuf::Codec, codec);
+  QFETCH(QString, baseName);
+  QCOMPARE(CompressedStreamBuf::codecForFileName(fileName), codec);
+  QCOMPARE(CompressedStreamBuf::baseFileName(fileName), baseName);
+}
+
+void CompressedStreamBufTest::addCodecs()
+{
+  QTest::addColumn<CompressedStreamBuf::Codec>("codec");
+  QTest::newRow("gzip") << CompressedStreamBuf::Gzip;
+  QTest::newRow("zstd") << CompressedStreamBuf::Zstd;
+  QTest::newRow("xz") << CompressedStreamBuf::Xz;
+}
+
+void CompressedStreamBufTest::roundTrip_data()
+{
+  addCodecs();
+}
+
+void CompressedStreamBufTest::roundTrip()
+{
+  QFETCH(CompressedStreamBuf::Codec, codec);
+  if (!CompressedStreamBuf::isSupported(codec))
+    QSKIP("The library for this codec was not found at build time.");
+
+  QByteArray data = testData();
+  QByteArray compressed = compress(data, codec);
+  QVERIFY(!compressed.isEmpty());
+  QVERIFY(compressed.size() < data.size());
+
+  // Files are recognized by what compress() writes.
+  QCOMPARE(CompressedStreamBuf::detect(compressed.constData(),
+                                       compressed.size()),
+           codec);
+
+  bool valid = false;
+  QCOMPARE(decompress(compressed, codec, valid), data);
+  QVERIFY(valid);
+}
+
+void CompressedStreamBufTest::concatenated_data()
+{
+  addCodecs();
+}
+
+void CompressedStreamBufTest::concatenated()
+{
+  QFETCH(CompressedStreamBuf::Codec, codec);
+  if (!CompressedStreamBuf::isSupported(codec))
+    QSKIP("The library for this codec was not found at build time.");
+
+  // As written by e.g. "cat a.xyz.gz b.xyz.gz".
+  QByteArray first = "3\nfirst\nO 0 0 0\nH 0 0 1\nH 0 1 0\n";
+  QByteArray second = "3\nsecond\nO 0 0 0\nH 0 0 1\nH 0 1 0\n";
+  bool valid = false;
+  QCOMPARE(decompress(compress(first, codec) + compress(second, codec), codec,
+                      valid),
+           first + second);
+  QVERIFY(valid);
+}
+
+void CompressedStreamBufTest::truncated_data()
+{
+  addCodecs();
+}
+
+void CompressedStreamBufTest::truncated()
+{
+  QFETCH(CompressedStreamBuf::Codec, codec);
+  if (!CompressedStreamBuf::isSupported(codec))
+    QSKIP("The library for this codec was not found at build time.");
+
+  QByteArray data = testData();
+  QByteArray compressed = compress(data, codec);
+  bool valid = true;
+  QByteArray result =
+    decompress(compressed.left(compressed.size() / 2), codec, valid);
+  QVERIFY(!valid);
+  QVERIFY(result.size() < data.size());
+  QVERIFY(data.startsWith(result));
+}
+
+void CompressedStreamBufTest::cancel_data()
+{
+  addCodecs();
+}
+
+void CompressedStreamBufTest::cancel()
+{
+  QFETCH(CompressedStreamBuf::Codec, codec);
+  if (!CompressedStreamBuf::isSupported(codec))
+    QSKIP("The library for this codec was not found at build time.");
+
+  // Layered as BackgroundFileFormat does, canceled halfway.
+  QByteArray data = testData();
+  QByteArray compressed = compress(data, codec);
+  QBuffer device(&compressed);
+  QVERIFY(device.open(QIODevice::ReadOnly));
+  std::atomic_bool canceled(false);
+  std::atomic<long long> bytes(0);
+  IODeviceStreamBuf source(&device, &canceled, &bytes, 4096);
+  CompressedStreamBuf buffer(&source, codec, std::ios_base::in);
+  std::istream stream(&buffer);
+
+  long long read = 0;
+  char c;
+  while (stream.get(c)) {
+    if (++read == data.size() / 2)
+      canceled = true;
+  }
+  QVERIFY(source.wasCanceled());
+  QVERIFY(read < data.size());
+  QVERIFY(bytes.load() < compressed.size());
+}
+
+void CompressedStreamBufTest::seek_data()
+{
+  addCodecs();
+}
+
+void CompressedStreamBufTest::seek()
+{
+  QFETCH(CompressedStreamBuf::Codec, codec);
+  if (!CompressedStreamBuf::isSupported(codec))
+    QSKIP("The library for this codec was not found at build time.");
+
+  QByteArray data = testData();
+  std::stringbuf input(compress(data, codec).toStdString());
+  CompressedStreamBuf buffer(&input, codec, std::ios_base::in);
+  std::istream stream(&buffer);
+
+  std::string line;
+  std::getline(stream, line);
+  QCOMPARE(static_cast<long long>(stream.tellg()),
+           static_cast<long long>(line.size() + 1));
+
+  // Forward, past several decompressed blocks.
+  qint64 offset = data.indexOf('\n', data.size() / 2) + 1;
+  stream.seekg(offset);
+  QVERIFY(stream.good());
+  QCOMPARE(static_cast<qint64>(stream.tellg()), offset);
+  std::getline(stream, line);
+  QCOMPARE(QByteArray::fromStdString(line),
+           data.mid(offset, data.indexOf('\n', offset) - offset));
+
+  // Back to the start, the way formats read a file twice.
+  stream.seekg(0);
+  QVERIFY(stream.good());
+  std::getline(stream, line);
+  QCOMPARE(QByteArray::fromStdString(line), data.left(data.indexOf('\n')));
+
+  stream.seekg(-10, std::ios_base::end);
+  QVERIFY(stream.good());
+  QCOMPARE(static_cast<qint64>(stream.tellg()), qint64(data.size() - 10));
+  char tail[10];
+  stream.read(tail, sizeof(tail));
+  QCOMPARE(QByteArray(tail, sizeof(tail)), data.right(10));
+
+  // Out of range.
+  stream.clear();
+  stream.seekg(data.size() + 1);
+  QVERIFY(stream.fail());
+  QVERIFY(buffer.isValid());
+}
+
+void CompressedStreamBufTest::unsupported()
+{
+  std::stringbuf input("3\nwater\n");
+  CompressedStreamBuf buffer(&input, CompressedStreamBuf::None,
+                             std::ios_base::in);
+  QVERIFY(!buffer.isValid());
+  std::istream stream(&buffer);
+  QCOMPARE(stream.get(), std::istream::traits_type::eof());
+  QVERIFY(!CompressedStreamBuf::isSupported(CompressedStreamBuf::None));
+}
+
+QTEST_GUILESS_MAIN(CompressedStreamBufTest)
+#include "compressedstreambuftest.moc"
@@ -0,0 +1,255 @@
+/******************************************************************************
+  This source file is part of the Avogadro project.
+  This source code is released under the 3-Clause BSD License, (see "LICENSE").
+******************************************************************************/
+
+#include "backgroundfileformat.h"
+#include "filejobqueue.h"
+#include "moleculecache.h"
+
+#include <avogadro/core/molecule.h>
+#include <avogadro/io/fileformat.h>
+
+#include <QtConcurrent/QtConcurrentRun>
+#include <QtCore/QFile>
+#include <QtCore/QSemaphore>
+#include <QtCore/QStandardPaths>
+#include <QtCore/QTemporaryDir>
+#include <QtCore/QThread>
+#include <QtTest/QSignalSpy>
+#include <QtTest/QtTest>
+
+#include <atomic>
+#include <istream>
+#include <ostream>
+#include <string>
+
+using Avogadro::BackgroundFileFormat;
+using Avogadro::FileJobQueue;
+using Avogadro::MoleculeCache;
+using Avogadro::Core::Molecule;
+
+namespace {
+const int atomCount = 100000;
+
+/**
+ * One carbon atom per line. While gated, a read stops after its first line
+ * until the test opens the gate.
+ */
+class LineFormat : public Avogadro::Io::FileFormat
+{
+public:
+  static std::atomic_bool gated;
+  static std::atomic_int linesRead;
+  static QSemaphore started;
+  static QSemaphore gate;
+
+  Operations supportedOperations() const override
+  {
+    return Read | Write | File | Stream;
+  }
+
+  bool read(std::istream& in, Molecule& molecule) override
+  {
+    std::string line;
+    while (std::getline(in, line)) {
+      if (line != "C") {
+        appendError("Unexpected line: " + line);
+        return false;
+      }
+      molecule.addAtom(6);
+      if (++linesRead == 1 && gated) {
+        started.release();
+        gate.acquire();
+      }
+    }
+    return true;
+  }
+
+  bool write(std::ostream& out, const Molecule& molecule) override
+  {
+    for (Avogadro::Index i = 0; i < molecule.atomCount(); ++i)
+      out << "C\n";
+    return true;
+  }
+
+  FileFormat* newInstance() const override { return new LineFormat; }
+  std::string identifier() const override { return "Test: lines"; }
+  std::string name() const override { return "Lines"; }
+  std::string description() const override { return "One atom per line."; }
+  std::string specificationUrl() const override { return std::string(); }
+  std::vector<std::string> fileExtensions() const override
+  {
+    return std::vector<std::string>(1, "lines");
+  }
+  std::vector<std::string> mimeTypes() const override
+  {
+    return std::vector<std::string>();
+  }
+};
+
+std::atomic_bool LineFormat::gated(false);
+std::atomic_int LineFormat::linesRead(0);
+QSemaphore LineFormat::started;
+QSemaphore LineFormat::gate;
+} // namespace
+
+class FileJobQueueTest : public QObject
+{
+  Q_OBJECT
+
+private slots:
+  void initTestCase();
+  void init();
+
+  void read();
+  void write();
+  void queued();
+  void cancelMidStream();
+  void cancelOnDestruction();
+
+private:
+  QTemporaryDir m_dir;
+  QString m_fileName;
+};
+
+void FileJobQueueTest::initTestCase()
+{
+  // Every read must parse the file.
+  QStandardPaths::setTestModeEnabled(true);
+  MoleculeCache::instance().setEnabled(false);
+
+  // Several blocks of the stream buffer, so a cancel lands mid-file.
+  QVERIFY(m_dir.isValid());
+  m_fileName = m_dir.filePath("atoms.lines");
+  QFile file(m_fileName);
+  QVERIFY(file.open(QIODevice::WriteOnly));
+  for (int i = 0; i < atomCount; ++i)
+    file.write("C\n");
+}
+
+void FileJobQueueTest::init()
+{
+  LineFormat::gated = false;
+  LineFormat::linesRead = 0;
+}
+
+void FileJobQueueTest::read()
+{
+  FileJobQueue queue;
+  QSignalSpy finished(&queue, &FileJobQueue::finished);
+  Molecule molecule;
+  bool checked = false;
+  int id = queue.read(m_fileName, new LineFormat, &molecule);
+  QCOMPARE(queue.count(FileJobQueue::Read), 1);
+  QCOMPARE(queue.operation(id), FileJobQueue::Read);
+
+  // The job is only available until finished() was handled.
+  connect(&queue, &FileJobQueue::finished, this, [&](int finishedId) {
+    BackgroundFileFormat* job = queue.job(finishedId);
+    QVERIFY(job);
+    QVERIFY2(job->success(), qPrintable(job->error()));
+    QCOMPARE(job->bytesProcessed(), job->bytesTotal());
+    checked = true;
+  });
+  QVERIFY(finished.wait(5000));
+  QVERIFY(checked);
+  QCOMPARE(finished.first().first().toInt(), id);
+  QVERIFY(!queue.job(id));
+  QCOMPARE(queue.count(FileJobQueue::Read), 0);
+  QCOMPARE(molecule.atomCount(), Avogadro::Index(atomCount));
+}
+
+void FileJobQueueTest::write()
+{
+  FileJobQueue queue;
+  QSignalSpy finished(&queue, &FileJobQueue::finished);
+  Molecule molecule;
+  for (int i = 0; i < 10; ++i)
+    molecule.addAtom(6);
+
+  QString fileName = m_dir.filePath("written.lines");
+  int id = queue.write(fileName, new LineFormat, &molecule);
+  QCOMPARE(queue.count(FileJobQueue::Write), 1);
+  QCOMPARE(queue.count(FileJobQueue::Read), 0);
+  QCOMPARE(queue.operation(id), FileJobQueue::Write);
+  QVERIFY(finished.wait(5000));
+
+  QFile file(fileName);
+  QVERIFY(file.open(QIODevice::ReadOnly));
+  QCOMPARE(file.readAll(), QByteArray("C\n").repeated(10));
+}
+
+void FileJobQueueTest::queued()
+{
+  FileJobQueue queue;
+  queue.setMaxThreadCount(1);
+  QSignalSpy finished(&queue, &FileJobQueue::finished);
+  LineFormat::gated = true;
+
+  // The first read holds the only worker, the others wait for it.
+  Molecule molecules[3];
+  QList<int> ids;
+  for (Molecule& molecule : molecules)
+    ids << queue.read(m_fileName, new LineFormat, &molecule);
+  QVERIFY(LineFormat::started.tryAcquire(1, 5000));
+  QCOMPARE(queue.count(FileJobQueue::Read), 3);
+  QCOMPARE(queue.job(ids.last())->bytesProcessed(), qint64(0));
+
+  LineFormat::gated = false;
+  LineFormat::gate.release();
+  while (finished.count() < 3)
+    QVERIFY(finished.wait(5000));
+  for (int i = 0; i < 3; ++i) {
+    QCOMPARE(finished.at(i).first().toInt(), ids.at(i));
+    QCOMPARE(molecules[i].atomCount(), Avogadro::Index(atomCount));
+  }
+  QCOMPARE(queue.count(FileJobQueue::Read), 0);
+}
+
+void FileJobQueueTest::cancelMidStream()
+{
+  FileJobQueue queue;
+  QSignalSpy finished(&queue, &FileJobQueue::finished);
+  LineFormat::gated = true;
+  Molecule molecule;
+  int id = queue.read(m_fileName, new LineFormat, &molecule);
+  QVERIFY(LineFormat::started.tryAcquire(1, 5000));
+
+  bool checked = false;
+  connect(&queue, &FileJobQueue::finished, this, [&](int finishedId) {
+    BackgroundFileFormat* job = queue.job(finishedId);
+    QVERIFY(job->isCanceled());
+    QVERIFY(!job->success());
+    QVERIFY(job->bytesProcessed() < job->bytesTotal());
+    checked = true;
+  });
+  queue.cancel(id);
+  LineFormat::gate.release();
+  QVERIFY(finished.wait(5000));
+  QVERIFY(checked);
+
+  // The format saw the end of the stream after the block it had.
+  QVERIFY(LineFormat::linesRead > 0);
+  QVERIFY(LineFormat::linesRead < atomCount);
+}
+
+void FileJobQueueTest::cancelOnDestruction()
+{
+  auto* queue = new FileJobQueue;
+  LineFormat::gated = true;
+  Molecule molecule;
+  queue->read(m_fileName, new LineFormat, &molecule);
+  QVERIFY(LineFormat::started.tryAcquire(1, 5000));
+
+  // Opened once the destructor canceled the read and waits for it.
+  QtConcurrent::run([]() {
+    QThread::msleep(100);
+    LineFormat::gate.release();
+  });
+  delete queue;
+  QVERIFY(LineFormat::linesRead < atomCount);
+}
+
+QTEST_GUILESS_MAIN(FileJobQueueTest)
+#include "filejobqueuetest.moc"
@@ -0,0 +1,114 @@
+/******************************************************************************
+  This source file is part of the Avogadro project.
+  This source code is released under the 3-Clause BSD License, (see "LICENSE").
+******************************************************************************/
+
+#include "idletaskqueue.h"
+
+#include <QtCore/QTimer>
+#include <QtTest/QSignalSpy>
+#include <QtTest/QtTest>
+
+using Avogadro::IdleTaskQueue;
+
+class IdleTaskQueueTest : public QObject
+{
+  Q_OBJECT
+
+private slots:
+  void runsInOrder();
+  void onePerPass();
+  void postWhileRunning();
+  void flush();
+  void emptyQueue();
+};
+
+void IdleTaskQueueTest::runsInOrder()
+{
+  IdleTaskQueue queue;
+  QSignalSpy finished(&queue, &IdleTaskQueue::finished);
+  QStringList ran;
+  queue.post("first", [&ran]() { ran << "first"; });
+  queue.post("second", [&ran]() { ran << "second"; });
+  queue.post("third", [&ran]() { ran << "third"; });
+
+  // Nothing runs before start().
+  QTest::qWait(20);
+  QVERIFY(ran.isEmpty());
+  QVERIFY(!queue.isEmpty());
+
+  queue.start();
+  QVERIFY(ran.isEmpty());
+  QVERIFY(finished.wait(1000));
+  QCOMPARE(ran, QStringList() << "first" << "second" << "third");
+  QCOMPARE(finished.count(), 1);
+  QVERIFY(queue.isEmpty());
+}
+
+void IdleTaskQueueTest::onePerPass()
+{
+  IdleTaskQueue queue;
+  QSignalSpy finished(&queue, &IdleTaskQueue::finished);
+  QStringList ran;
+  queue.post("first", [&ran]() { ran << "first"; });
+  queue.post("second", [&ran]() { ran << "second"; });
+
+  // An event posted before the first task must be handled between them.
+  queue.start();
+  QTimer::singleShot(0, [&ran]() { ran << "event"; });
+  QVERIFY(finished.wait(1000));
+  QCOMPARE(ran.last(), QString("second"));
+  QVERIFY(ran.indexOf("event") < ran.indexOf("second"));
+}
+
+void IdleTaskQueueTest::postWhileRunning()
+{
+  IdleTaskQueue queue;
+  QSignalSpy finished(&queue, &IdleTaskQueue::finished);
+  QStringList ran;
+  queue.post("first", [&]() {
+    ran << "first";
+    queue.post("posted", [&ran]() { ran << "posted"; });
+  });
+  queue.post("second", [&ran]() { ran << "second"; });
+  queue.start();
+
+  QVERIFY(finished.wait(1000));
+  QCOMPARE(ran, QStringList() << "first" << "second" << "posted");
+  QCOMPARE(finished.count(), 1);
+}
+
+void IdleTaskQueueTest::flush()
+{
+  IdleTaskQueue queue;
+  QSignalSpy finished(&queue, &IdleTaskQueue::finished);
+  QStringList ran;
+  queue.post("first", [&ran]() { ran << "first"; });
+  queue.post("second", [&ran]() { ran << "second"; });
+  queue.start();
+
+  queue.flush();
+  QCOMPARE(ran, QStringList() << "first" << "second");
+  QCOMPARE(finished.count(), 1);
+  QVERIFY(queue.isEmpty());
+
+  // The stopped timer runs nothing twice.
+  QTest::qWait(20);
+  QCOMPARE(ran.size(), 2);
+  QCOMPARE(finished.count(), 1);
+
+  // Flushing an empty queue does not finish again.
+  queue.flush();
+  QCOMPARE(finished.count(), 1);
+}
+
+void IdleTaskQueueTest::emptyQueue()
+{
+  IdleTaskQueue queue;
+  QSignalSpy finished(&queue, &IdleTaskQueue::finished);
+  queue.start();
+  QCOMPARE(finished.count(), 1);
+}
+
+QTEST_GUILESS_MAIN(IdleTaskQueueTest)
+#include "idletaskqueuetest.moc"
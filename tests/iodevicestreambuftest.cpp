@@ -0,0 +1,159 @@
+/******************************************************************************
+  This source file is part of the Avogadro project.
+  This source code is released under the 3-Clause BSD License, (see "LICENSE").
+******************************************************************************/
+
+#include "iodevicestreambuf.h"
+
+#include <QtCore/QBuffer>
+#include <QtTest/QtTest>
+
+#include <istream>
+#include <ostream>
+#include <string>
+
+using Avogadro::IODeviceStreamBuf;
+
+namespace {
+const int blockSize = 4096;
+
+QByteArray testData()
+{
+  QByteArray data;
+  for (int i = 0; data.size() < 200000; ++i)
+    data += "C " + QByteArray::number(i) + " 0.0 0.0 0.0\n";
+  return data;
+}
+} // namespace
+
+class IODeviceStreamBufTest : public QObject
+{
+  Q_OBJECT
+
+private slots:
+  void read();
+  void cancelRead();
+  void write();
+  void cancelWrite();
+  void seek();
+};
+
+void IODeviceStreamBufTest::read()
+{
+  QByteArray data = testData();
+  QBuffer device(&data);
+  QVERIFY(device.open(QIODevice::ReadOnly));
+  std::atomic<long long> bytes(0);
+  IODeviceStreamBuf buffer(&device, nullptr, &bytes, blockSize);
+  std::istream stream(&buffer);
+
+  std::string line;
+  std::string read;
+  while (std::getline(stream, line))
+    read += line + '\n';
+  QCOMPARE(QByteArray::fromStdString(read), data);
+  QCOMPARE(bytes.load(), static_cast<long long>(data.size()));
+  QVERIFY(!buffer.wasCanceled());
+}
+
+void IODeviceStreamBufTest::cancelRead()
+{
+  QByteArray data = testData();
+  QBuffer device(&data);
+  QVERIFY(device.open(QIODevice::ReadOnly));
+  std::atomic_bool canceled(false);
+  std::atomic<long long> bytes(0);
+  IODeviceStreamBuf buffer(&device, &canceled, &bytes, blockSize);
+  std::istream stream(&buffer);
+
+  // Cancel halfway, as the main thread would while a format reads.
+  long long read = 0;
+  char c;
+  while (stream.get(c)) {
+    if (++read == data.size() / 2)
+      canceled = true;
+  }
+
+  // The block already read is handed out, nothing after it.
+  QVERIFY(buffer.wasCanceled());
+  QVERIFY(stream.eof());
+  QVERIFY(read < data.size());
+  QVERIFY(read <= data.size() / 2 + blockSize);
+  QCOMPARE(bytes.load(), read);
+}
+
+void IODeviceStreamBufTest::write()
+{
+  QByteArray data = testData();
+  QByteArray written;
+  QBuffer device(&written);
+  QVERIFY(device.open(QIODevice::WriteOnly));
+  std::atomic<long long> bytes(0);
+  {
+    IODeviceStreamBuf buffer(&device, nullptr, &bytes, blockSize);
+    std::ostream stream(&buffer);
+    stream << data.constData();
+    QVERIFY(stream.good());
+    QCOMPARE(static_cast<long long>(stream.tellp()),
+             static_cast<long long>(data.size()));
+  }
+  // The last block is written when the buffer is destroyed.
+  QCOMPARE(written, data);
+  QCOMPARE(bytes.load(), static_cast<long long>(data.size()));
+}
+
+void IODeviceStreamBufTest::cancelWrite()
+{
+  QByteArray data = testData();
+  QByteArray written;
+  QBuffer device(&written);
+  QVERIFY(device.open(QIODevice::WriteOnly));
+  std::atomic_bool canceled(false);
+  IODeviceStreamBuf buffer(&device, &canceled, nullptr, blockSize);
+  std::ostream stream(&buffer);
+
+  int half = data.size() / 2;
+  stream.write(data.constData(), half);
+  QVERIFY(stream.good());
+  canceled = true;
+  stream.write(data.constData() + half, data.size() - half);
+  stream.flush();
+
+  QVERIFY(stream.bad());
+  QVERIFY(buffer.wasCanceled());
+  QVERIFY(written.size() <= half);
+  QVERIFY(data.startsWith(written));
+}
+
+void IODeviceStreamBufTest::seek()
+{
+  QByteArray data = testData();
+  QBuffer device(&data);
+  QVERIFY(device.open(QIODevice::ReadOnly));
+  std::atomic<long long> bytes(0);
+  IODeviceStreamBuf buffer(&device, nullptr, &bytes, blockSize);
+  std::istream stream(&buffer);
+
+  std::string line;
+  std::getline(stream, line);
+  QCOMPARE(static_cast<long long>(stream.tellg()),
+           static_cast<long long>(line.size() + 1));
+
+  // Past the first block, the way formats jump to a frame.
+  qint64 offset = data.indexOf('\n', 3 * blockSize) + 1;
+  stream.seekg(offset);
+  QVERIFY(stream.good());
+  QCOMPARE(static_cast<qint64>(stream.tellg()), offset);
+  QCOMPARE(bytes.load(), static_cast<long long>(offset));
+  std::getline(stream, line);
+  QCOMPARE(QByteArray::fromStdString(line),
+           data.mid(offset, data.indexOf('\n', offset) - offset));
+
+  stream.seekg(-10, std::ios_base::end);
+  char tail[10];
+  stream.read(tail, sizeof(tail));
+  QCOMPARE(QByteArray(tail, sizeof(tail)), data.right(10));
+}
+
+QTEST_GUILESS_MAIN(IODeviceStreamBufTest)
+#include "iodevicestreambuftest.moc"
@@ -0,0 +1,197 @@
+/******************************************************************************
+  This source file is part of the Avogadro project.
+  This source code is released under the 3-Clause BSD License, (see "LICENSE").
+******************************************************************************/
+
+#include "iodevicestreambuf.h"
+#include "memorystreambuf.h"
+
+#include <QtCore/QFile>
+#include <QtCore/QTemporaryDir>
+#include <QtTest/QtTest>
+
+#include <istream>
+#include <streambuf>
+#include <string>
+
+using Avogadro::IODeviceStreamBuf;
+using Avogadro::MemoryStreamBuf;
+
+namespace {
+const int blockSize = 4096;
+
+QByteArray testData(int size)
+{
+  QByteArray data;
+  data.reserve(size + 64);
+  for (int i = 0; data.size() < size; ++i) {
+    data += "C " + QByteArray::number(i) + " " + QByteArray::number(i * 0.5) +
+            " 0.0 0.0\n";
+  }
+  return data;
+}
+
+/** Read @a buffer line by line, the way the text formats do. */
+int countLines(std::streambuf* buffer)
+{
+  std::istream stream(buffer);
+  std::string line;
+  int lines = 0;
+  while (std::getline(stream, line))
+    ++lines;
+  return lines;
+}
+} // namespace
+
+class MemoryStreamBufTest : public QObject
+{
+  Q_OBJECT
+
+private slots:
+  void initTestCase();
+
+  void read();
+  void cancel();
+  void seek();
+  void empty();
+
+  void readFile_data();
+  void readFile();
+
+private:
+  QTemporaryDir m_dir;
+  QString m_fileName;
+  int m_lines;
+};
+
+void MemoryStreamBufTest::initTestCase()
+{
+  // Large enough for the page cache to matter, small enough for every run.
+  QVERIFY(m_dir.isValid());
+  m_fileName = m_dir.filePath("benchmark.xyz");
+  QByteArray data = testData(16 << 20);
+  m_lines = static_cast<int>(data.count('\n'));
+  QFile file(m_fileName);
+  QVERIFY(file.open(QIODevice::WriteOnly));
+  QCOMPARE(file.write(data), qint64(data.size()));
+}
+
+void MemoryStreamBufTest::read()
+{
+  QByteArray data = testData(100000);
+  std::atomic<long long> bytes(0);
+  MemoryStreamBuf buffer(data.constData(), data.size(), nullptr, &bytes,
+                         blockSize);
+  std::istream stream(&buffer);
+
+  std::string line;
+  std::string read;
+  while (std::getline(stream, line))
+    read += line + '\n';
+  QCOMPARE(QByteArray::fromStdString(read), data);
+  QCOMPARE(bytes.load(), static_cast<long long>(data.size()));
+  QVERIFY(!buffer.wasCanceled());
+}
+
+void MemoryStreamBufTest::cancel()
+{
+  QByteArray data = testData(100000);
+  std::atomic_bool canceled(false);
+  std::atomic<long long> bytes(0);
+  MemoryStreamBuf buffer(data.constData(), data.size(), &canceled, &bytes,
+                         blockSize);
+  std::istream stream(&buffer);
+
+  long long read = 0;
+  char c;
+  while (stream.get(c)) {
+    if (++read == data.size() / 2)
+      canceled = true;
+  }
+
+  // The current window is handed out, nothing after it.
+  QVERIFY(buffer.wasCanceled());
+  QVERIFY(stream.eof());
+  QVERIFY(read < data.size());
+  QVERIFY(read <= data.size() / 2 + static_cast<long long>(blockSize));
+  QCOMPARE(bytes.load(), read);
+  QVERIFY(bytes.load() < data.size());
+}
+
+void MemoryStreamBufTest::seek()
+{
+  QByteArray data = testData(100000);
+  std::atomic<long long> bytes(0);
+  MemoryStreamBuf buffer(data.constData(), data.size(), nullptr, &bytes,
+                         blockSize);
+  std::istream stream(&buffer);
+
+  std::string line;
+  std::getline(stream, line);
+  QCOMPARE(static_cast<long long>(stream.tellg()),
+           static_cast<long long>(line.size() + 1));
+
+  qint64 offset = data.indexOf('\n', 3 * blockSize) + 1;
+  stream.seekg(offset);
+  QVERIFY(stream.good());
+  QCOMPARE(static_cast<qint64>(stream.tellg()), offset);
+  QCOMPARE(bytes.load(), static_cast<long long>(offset));
+  std::getline(stream, line);
+  QCOMPARE(QByteArray::fromStdString(line),
+           data.mid(offset, data.indexOf('\n', offset) - offset));
+
+  stream.seekg(-10, std::ios_base::end);
+  char tail[10];
+  stream.read(tail, sizeof(tail));
+  QCOMPARE(QByteArray(tail, sizeof(tail)), data.right(10));
+
+  // Out of range.
+  stream.clear();
+  stream.seekg(data.size() + 1);
+  QVERIFY(stream.fail());
+}
+
+void MemoryStreamBufTest::empty()
+{
+  MemoryStreamBuf buffer(nullptr, 0);
+  QCOMPARE(countLines(&buffer), 0);
+}
+
+void MemoryStreamBufTest::readFile_data()
+{
+  QTest::addColumn<bool>("mapped");
+  QTest::newRow("mapped") << true;
+  QTest::newRow("buffered") << false;
+}
+
+/**
+ * Compares the two paths BackgroundFileFormat reads stream formats through,
+ * over the same file in the page cache.
+ */
+void MemoryStreamBufTest::readFile()
+{
+  QFETCH(bool, mapped);
+  QFile file(m_fileName);
+  QVERIFY(file.open(QIODevice::ReadOnly));
+
+  QBENCHMARK
+  {
+    file.seek(0);
+    int lines = 0;
+    if (mapped) {
+      uchar* memory = file.map(0, file.size());
+      QVERIFY(memory);
+      MemoryStreamBuf buffer(reinterpret_cast<const char*>(memory),
+                             static_cast<std::size_t>(file.size()));
+      lines = countLines(&buffer);
+      file.unmap(memory);
+    } else {
+      IODeviceStreamBuf buffer(&file);
+      lines = countLines(&buffer);
+    }
+    QCOMPARE(lines, m_lines);
+  }
+}
+
+QTEST_GUILESS_MAIN(MemoryStreamBufTest)
+#include "memorystreambuftest.moc"
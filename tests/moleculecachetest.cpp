@@ -0,0 +1,331 @@
+/******************************************************************************
+  This source file is part of the Avogadro project.
+  This source code is released under the 3-Clause BSD License, (see "LICENSE").
+******************************************************************************/
+
+#include "moleculecache.h"
+
+#include <avogadro/core/molecule.h>
+#include <avogadro/core/vector.h>
+#include <avogadro/io/cjsonformat.h>
+#include <avogadro/io/xyzformat.h>
+
+#include <QtCore/QDateTime>
+#include <QtCore/QFile>
+#include <QtCore/QStandardPaths>
+#include <QtCore/QTemporaryDir>
+#include <QtCore/QThread>
+#include <QtCore/QThreadPool>
+#include <QtTest/QtTest>
+
+using Avogadro::MoleculeCache;
+using Avogadro::Vector3;
+using Avogadro::Core::Molecule;
+
+namespace {
+const QString reader = "XYZ";
+
+Molecule water()
+{
+  Molecule molecule;
+  molecule.addAtom(8).setPosition3d(Vector3(0.0, 0.0, 0.117));
+  molecule.addAtom(1).setPosition3d(Vector3(0.0, 0.757, -0.467));
+  molecule.addAtom(1).setPosition3d(Vector3(0.0, -0.757, -0.467));
+  return molecule;
+}
+
+/** Entries are written in the background. */
+void store(const QString& fileName, const Molecule& molecule,
+           const QString& with = reader)
+{
+  MoleculeCache::instance().store(fileName, with, molecule);
+  MoleculeCache::instance().threadPool()->waitForDone();
+}
+
+/** A trajectory of @a frames frames of @a atoms atoms, as XYZ text. */
+QByteArray trajectory(int atoms, int frames)
+{
+  QByteArray data;
+  for (int frame = 0; frame < frames; ++frame) {
+    data += QByteArray::number(atoms) + "\nframe " +
+            QByteArray::number(frame) + "\n";
+    for (int i = 0; i < atoms; ++i) {
+      data += "C " + QByteArray::number(i * 1.5, 'f', 5) + " " +
+              QByteArray::number(frame * 0.01, 'f', 5) + " 0.00000\n";
+    }
+  }
+  return data;
+}
+
+bool isCached(const QString& fileName)
+{
+  Molecule molecule;
+  return MoleculeCache::instance().read(fileName, reader, molecule);
+}
+} // namespace
+
+class MoleculeCacheTest : public QObject
+{
+  Q_OBJECT
+
+private slots:
+  void initTestCase();
+  void init();
+  void cleanupTestCase();
+
+  void hit();
+  void otherReader();
+  void sizeChanged();
+  void modificationTimeChanged();
+  void eviction();
+  void leastRecentlyUsed();
+  void disabled();
+  void cjsonNotCached();
+  void frames();
+  void threadPool();
+
+  void readTrajectory_data();
+  void readTrajectory();
+
+private:
+  QTemporaryDir m_dir;
+
+  QString sourceFile(const QString& name);
+};
+
+void MoleculeCacheTest::initTestCase()
+{
+  // Keep the entries of the installed application out of the tests.
+  QStandardPaths::setTestModeEnabled(true);
+  QVERIFY(m_dir.isValid());
+}
+
+void MoleculeCacheTest::init()
+{
+  MoleculeCache& cache = MoleculeCache::instance();
+  cache.clear();
+  cache.setEnabled(true);
+  cache.setMaximumSize(qint64(1) << 30);
+}
+
+void MoleculeCacheTest::cleanupTestCase()
+{
+  MoleculeCache::instance().clear();
+}
+
+QString MoleculeCacheTest::sourceFile(const QString& name)
+{
+  // Only the size and modification time of the source are used.
+  QString fileName = m_dir.filePath(name);
+  QFile file(fileName);
+  file.open(QIODevice::WriteOnly | QIODevice::Truncate);
+  file.write("3\nwater\nO 0.0 0.0 0.117\nH 0.0 0.757 -0.467\n"
+             "H 0.0 -0.757 -0.467\n");
+  return fileName;
+}
+
+void MoleculeCacheTest::hit()
+{
+  MoleculeCache& cache = MoleculeCache::instance();
+  QString fileName = sourceFile("water.xyz");
+  int hits = cache.hits();
+  int misses = cache.misses();
+  QVERIFY(!isCached(fileName));
+  QCOMPARE(cache.misses(), misses + 1);
+
+  store(fileName, water());
+  QVERIFY(cache.size() > 0);
+
+  Molecule molecule;
+  QVERIFY(cache.read(fileName, reader, molecule));
+  QCOMPARE(cache.hits(), hits + 1);
+  QCOMPARE(molecule.atomCount(), water().atomCount());
+  QCOMPARE(molecule.formula(), water().formula());
+  QVERIFY(molecule.atomPosition3d(1).isApprox(water().atomPosition3d(1)));
+
+  // A miss leaves the molecule alone.
+  Molecule unchanged = water();
+  QVERIFY(!cache.read(m_dir.filePath("missing.xyz"), reader, unchanged));
+  QCOMPARE(unchanged.atomCount(), water().atomCount());
+}
+
+void MoleculeCacheTest::otherReader()
+{
+  QString fileName = sourceFile("water.xyz");
+  store(fileName, water());
+  Molecule molecule;
+  QVERIFY(!MoleculeCache::instance().read(fileName, "Open Babel", molecule));
+  QVERIFY(isCached(fileName));
+}
+
+void MoleculeCacheTest::sizeChanged()
+{
+  QString fileName = sourceFile("water.xyz");
+  store(fileName, water());
+  QVERIFY(isCached(fileName));
+
+  // Keep the modification time, only the size tells.
+  QDateTime modified = QFileInfo(fileName).lastModified();
+  QFile file(fileName);
+  QVERIFY(file.open(QIODevice::Append));
+  file.write("\n");
+  QVERIFY(file.flush());
+  QVERIFY(file.setFileTime(modified, QFileDevice::FileModificationTime));
+  file.close();
+  QVERIFY(!isCached(fileName));
+}
+
+void MoleculeCacheTest::modificationTimeChanged()
+{
+  QString fileName = sourceFile("water.xyz");
+  store(fileName, water());
+  QVERIFY(isCached(fileName));
+
+  QFile file(fileName);
+  QVERIFY(file.open(QIODevice::ReadWrite));
+  QVERIFY(file.setFileTime(QFileInfo(fileName).lastModified().addSecs(60),
+                           QFileDevice::FileModificationTime));
+  file.close();
+  QVERIFY(!isCached(fileName));
+}
+
+void MoleculeCacheTest::eviction()
+{
+  MoleculeCache& cache = MoleculeCache::instance();
+  QString first = sourceFile("first.xyz");
+  QString second = sourceFile("second.xyz");
+  QString third = sourceFile("third.xyz");
+  store(first, water());
+  qint64 entrySize = cache.size();
+  QVERIFY(entrySize > 0);
+
+  // Room for two entries, the oldest goes when the third is stored.
+  cache.setMaximumSize(2 * entrySize + entrySize / 2);
+  QThread::msleep(20);
+  store(second, water());
+  QThread::msleep(20);
+  store(third, water());
+
+  QVERIFY(cache.size() <= cache.maximumSize());
+  QVERIFY(!isCached(first));
+  QVERIFY(isCached(second));
+  QVERIFY(isCached(third));
+}
+
+void MoleculeCacheTest::leastRecentlyUsed()
+{
+  MoleculeCache& cache = MoleculeCache::instance();
+  QString first = sourceFile("first.xyz");
+  QString second = sourceFile("second.xyz");
+  QString third = sourceFile("third.xyz");
+  store(first, water());
+  cache.setMaximumSize(2 * cache.size() + cache.size() / 2);
+  QThread::msleep(20);
+  store(second, water());
+
+  // Reading the first entry makes the second one the oldest.
+  QThread::msleep(20);
+  QVERIFY(isCached(first));
+  QThread::msleep(20);
+  store(third, water());
+
+  QVERIFY(isCached(first));
+  QVERIFY(!isCached(second));
+  QVERIFY(isCached(third));
+}
+
+void MoleculeCacheTest::disabled()
+{
+  MoleculeCache& cache = MoleculeCache::instance();
+  QString fileName = sourceFile("water.xyz");
+  store(fileName, water());
+
+  cache.setEnabled(false);
+  QVERIFY(!cache.isEnabled());
+  QVERIFY(!isCached(fileName));
+  store(sourceFile("other.xyz"), water());
+
+  cache.setEnabled(true);
+  QVERIFY(isCached(fileName));
+  QVERIFY(!isCached(m_dir.filePath("other.xyz")));
+}
+
+void MoleculeCacheTest::cjsonNotCached()
+{
+  QString fileName = sourceFile("water.cjson");
+  store(fileName, water(),
+        QString::fromStdString(Avogadro::Io::CjsonFormat().identifier()));
+  QCOMPARE(MoleculeCache::instance().size(), qint64(0));
+}
+
+void MoleculeCacheTest::frames()
+{
+  QString fileName = sourceFile("water.xyz");
+  Molecule molecule = water();
+  Avogadro::Core::Array<Vector3> positions = molecule.atomPositions3d();
+  molecule.setCoordinate3d(positions, 0);
+  for (Vector3& position : positions)
+    position += Vector3(0.5, 0.0, 0.0);
+  molecule.setCoordinate3d(positions, 1);
+  store(fileName, molecule);
+
+  Molecule cached;
+  QVERIFY(MoleculeCache::instance().read(fileName, reader, cached));
+  QCOMPARE(cached.coordinate3dCount(), 2);
+  QVERIFY(cached.coordinate3d(1)[2].isApprox(positions[2]));
+  QVERIFY(cached.atomPosition3d(2).isApprox(water().atomPosition3d(2)));
+}
+
+void MoleculeCacheTest::threadPool()
+{
+  MoleculeCache& cache = MoleculeCache::instance();
+  QCOMPARE(cache.threadPool(), QThreadPool::globalInstance());
+
+  QThreadPool pool;
+  cache.setThreadPool(&pool);
+  QCOMPARE(cache.threadPool(), &pool);
+  QString fileName = sourceFile("water.xyz");
+  cache.store(fileName, reader, water());
+  pool.waitForDone();
+  cache.setThreadPool(nullptr);
+  QVERIFY(isCached(fileName));
+}
+
+void MoleculeCacheTest::readTrajectory_data()
+{
+  QTest::addColumn<bool>("cached");
+  QTest::newRow("cache hit") << true;
+  QTest::newRow("xyz") << false;
+}
+
+/**
+ * Compares a hit with parsing the file again, for a trajectory of the size
+ * that gets cached.
+ */
+void MoleculeCacheTest::readTrajectory()
+{
+  QFETCH(bool, cached);
+  QString fileName = m_dir.filePath("trajectory.xyz");
+  QFile file(fileName);
+  QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+  file.write(trajectory(500, 200));
+  file.close();
+
+  Avogadro::Io::XyzFormat xyz;
+  Molecule read;
+  QVERIFY(xyz.readFile(fileName.toStdString(), read));
+  store(fileName, read);
+
+  QBENCHMARK
+  {
+    Molecule molecule;
+    if (cached)
+      QVERIFY(MoleculeCache::instance().read(fileName, reader, molecule));
+    else
+      QVERIFY(xyz.readFile(fileName.toStdString(), molecule));
+    QCOMPARE(molecule.coordinate3dCount(), read.coordinate3dCount());
+  }
+}
+
+QTEST_GUILESS_MAIN(MoleculeCacheTest)
+#include "moleculecachetest.moc"
@@ -0,0 +1,163 @@
+/******************************************************************************
+  This source file is part of the Avogadro project.
+  This source code is released under the 3-Clause BSD License, (see "LICENSE").
+******************************************************************************/
+
+#include "pluginmanifest.h"
+
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QStandardPaths>
+#include <QtTest/QtTest>
+
+using Avogadro::PluginManifest;
+
+class PluginManifestTest : public QObject
+{
+  Q_OBJECT
+
+private slots:
+  void initTestCase();
+  void cleanup();
+
+  void roundTrip();
+  void missingCache();
+  void corruptCache();
+  void staleScript();
+  void fileFormats();
+
+private:
+  static PluginManifest::ExtensionEntry extension();
+  static QString scriptDir();
+};
+
+void PluginManifestTest::initTestCase()
+{
+  // Keep the manifest of the installed application out of the tests.
+  QStandardPaths::setTestModeEnabled(true);
+}
+
+void PluginManifestTest::cleanup()
+{
+  QFile::remove(PluginManifest::cacheFileName());
+  QDir(scriptDir()).removeRecursively();
+}
+
+PluginManifest::ExtensionEntry PluginManifestTest::extension()
+{
+  PluginManifest::ActionEntry action;
+  action.text = "&Crystal…";
+  action.menuPath << "&Build";
+  action.priority = 70;
+  action.shortcut = "Ctrl+K";
+  action.checkable = true;
+  action.checked = true;
+
+  PluginManifest::ExtensionEntry entry;
+  entry.identifier = "Crystal";
+  entry.description = "Build crystals.";
+  entry.actions << action;
+  entry.commands["wrapAtomsToCell"] = "Wrap atoms into the unit cell.";
+  entry.fileFormats << "POSCAR";
+  return entry;
+}
+
+QString PluginManifestTest::scriptDir()
+{
+  return QStandardPaths::writableLocation(
+           QStandardPaths::AppLocalDataLocation) +
+         "/commands";
+}
+
+void PluginManifestTest::roundTrip()
+{
+  PluginManifest saved;
+  saved.setToolIdentifiers(QStringList() << "Navigator" << "Editor");
+  saved.setSceneIdentifiers(QStringList() << "BallStick");
+  saved.setExtension(extension());
+  QVERIFY(saved.save());
+
+  PluginManifest loaded;
+  QVERIFY(loaded.load());
+  QVERIFY(loaded.isValid());
+  QCOMPARE(loaded.toolIdentifiers(), saved.toolIdentifiers());
+  QCOMPARE(loaded.sceneIdentifiers(), saved.sceneIdentifiers());
+  QCOMPARE(loaded.extensions().size(), 1);
+
+  const PluginManifest::ExtensionEntry* entry = loaded.extension("Crystal");
+  QVERIFY(entry);
+  QCOMPARE(entry->description, extension().description);
+  QCOMPARE(entry->commands, extension().commands);
+  QCOMPARE(entry->fileFormats, extension().fileFormats);
+  QCOMPARE(entry->actions.size(), 1);
+  const PluginManifest::ActionEntry& action = entry->actions.first();
+  QCOMPARE(action.text, QString("&Crystal…"));
+  QCOMPARE(action.menuPath, QStringList() << "&Build");
+  QCOMPARE(action.priority, 70);
+  QCOMPARE(action.shortcut, QString("Ctrl+K"));
+  QVERIFY(action.checkable);
+  QVERIFY(action.checked);
+}
+
+void PluginManifestTest::missingCache()
+{
+  PluginManifest manifest;
+  QVERIFY(!manifest.load());
+  QVERIFY(!manifest.isValid());
+  QVERIFY(manifest.extensions().isEmpty());
+}
+
+void PluginManifestTest::corruptCache()
+{
+  QDir().mkpath(QFileInfo(PluginManifest::cacheFileName()).absolutePath());
+  QFile file(PluginManifest::cacheFileName());
+  QVERIFY(file.open(QIODevice::WriteOnly));
+  file.write("{ \"version\": ");
+  file.close();
+
+  PluginManifest manifest;
+  QVERIFY(!manifest.load());
+  QVERIFY(!manifest.isValid());
+}
+
+void PluginManifestTest::staleScript()
+{
+  PluginManifest saved;
+  saved.setExtension(extension());
+  QVERIFY(saved.save());
+
+  // A script plugin installed after the manifest was written.
+  QVERIFY(QDir().mkpath(scriptDir()));
+  QFile script(scriptDir() + "/script.py");
+  QVERIFY(script.open(QIODevice::WriteOnly));
+  script.write("print('{}')\n");
+  script.close();
+
+  PluginManifest loaded;
+  QVERIFY(!loaded.load());
+  QVERIFY(!loaded.isValid());
+  QVERIFY(loaded.extensions().isEmpty());
+}
+
+void PluginManifestTest::fileFormats()
+{
+  PluginManifest manifest;
+  manifest.setExtension(extension());
+  manifest.setFileFormats("Crystal", QStringList() << "POSCAR" << "CIF");
+  // Unknown extensions are ignored.
+  manifest.setFileFormats("Missing", QStringList() << "XYZ");
+
+  QCOMPARE(manifest.extensions().size(), 1);
+  QCOMPARE(manifest.extension("Crystal")->fileFormats,
+           QStringList() << "POSCAR" << "CIF");
+  QVERIFY(!manifest.extension("Missing"));
+
+  // Replacing an entry keeps one per identifier.
+  manifest.setExtension(extension());
+  QCOMPARE(manifest.extensions().size(), 1);
+  QCOMPARE(manifest.extension("Crystal")->fileFormats,
+           QStringList() << "POSCAR");
+}
+
+QTEST_MAIN(PluginManifestTest)
+#include "pluginmanifesttest.moc"
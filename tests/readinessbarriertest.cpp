@@ -0,0 +1,126 @@
+/******************************************************************************
+  This source file is part of the Avogadro project.
+  This source code is released under the 3-Clause BSD License, (see "LICENSE").
+******************************************************************************/
+
+#include "readinessbarrier.h"
+
+#include <QtTest/QSignalSpy>
+#include <QtTest/QtTest>
+
+using Avogadro::ReadinessBarrier;
+
+class ReadinessBarrierTest : public QObject
+{
+  Q_OBJECT
+
+private slots:
+  void nothingPending();
+  void waitsForPending();
+  void notReadyBeforeStart();
+  void unknownName();
+  void watchdog();
+  void firstMolecule();
+};
+
+void ReadinessBarrierTest::nothingPending()
+{
+  ReadinessBarrier barrier;
+  QSignalSpy ready(&barrier, &ReadinessBarrier::ready);
+  barrier.start(5000);
+
+  // Emitted from the event loop, never from start() itself.
+  QCOMPARE(ready.count(), 0);
+  QVERIFY(ready.wait(1000));
+  QCOMPARE(ready.count(), 1);
+  QVERIFY(barrier.isReady());
+}
+
+void ReadinessBarrierTest::waitsForPending()
+{
+  ReadinessBarrier barrier;
+  QSignalSpy ready(&barrier, &ReadinessBarrier::ready);
+  barrier.addPending("OpenBabel");
+  barrier.addPending("Scripts");
+  barrier.start(5000);
+  QTest::qWait(50);
+  QCOMPARE(ready.count(), 0);
+  QCOMPARE(barrier.pending(), QStringList() << "OpenBabel" << "Scripts");
+
+  barrier.markReady("Scripts");
+  QVERIFY(!barrier.isReady());
+  QVERIFY(barrier.isPending("OpenBabel"));
+  QVERIFY(!barrier.isPending("Scripts"));
+
+  barrier.markReady("OpenBabel");
+  QCOMPARE(ready.count(), 1);
+  QVERIFY(barrier.isReady());
+  QVERIFY(barrier.pending().isEmpty());
+
+  // Emitted once only.
+  barrier.addPending("Late");
+  barrier.markReady("Late");
+  QTest::qWait(50);
+  QCOMPARE(ready.count(), 1);
+}
+
+void ReadinessBarrierTest::notReadyBeforeStart()
+{
+  ReadinessBarrier barrier;
+  QSignalSpy ready(&barrier, &ReadinessBarrier::ready);
+  barrier.addPending("OpenBabel");
+  barrier.markReady("OpenBabel");
+  QTest::qWait(50);
+  QCOMPARE(ready.count(), 0);
+  QVERIFY(!barrier.isReady());
+
+  barrier.start(5000);
+  QVERIFY(ready.wait(1000));
+}
+
+void ReadinessBarrierTest::unknownName()
+{
+  ReadinessBarrier barrier;
+  QSignalSpy ready(&barrier, &ReadinessBarrier::ready);
+  barrier.addPending("OpenBabel");
+  barrier.start(5000);
+  barrier.markReady("Scripts");
+  QTest::qWait(50);
+  QCOMPARE(ready.count(), 0);
+  QVERIFY(barrier.isPending("OpenBabel"));
+}
+
+void ReadinessBarrierTest::watchdog()
+{
+  ReadinessBarrier barrier;
+  QSignalSpy ready(&barrier, &ReadinessBarrier::ready);
+  barrier.addPending("Stalled");
+  barrier.start(100);
+
+  QTest::ignoreMessage(QtWarningMsg,
+                       QRegularExpression("Still waiting for file formats"));
+  QVERIFY(ready.wait(2000));
+  QCOMPARE(ready.count(), 1);
+  QVERIFY(barrier.isReady());
+  QVERIFY(barrier.pending().isEmpty());
+
+  // A plugin reporting after the watchdog changes nothing.
+  barrier.markReady("Stalled");
+  QCOMPARE(ready.count(), 1);
+}
+
+void ReadinessBarrierTest::firstMolecule()
+{
+  ReadinessBarrier barrier;
+  QCOMPARE(barrier.timeToFirstMolecule(), qint64(-1));
+  QVERIFY(barrier.moleculeLoaded());
+  qint64 first = barrier.timeToFirstMolecule();
+  QVERIFY(first >= 0);
+
+  QTest::qWait(20);
+  QVERIFY(!barrier.moleculeLoaded());
+  QCOMPARE(barrier.timeToFirstMolecule(), first);
+}
+
+QTEST_GUILESS_MAIN(ReadinessBarrierTest)
+#include "readinessbarriertest.moc"
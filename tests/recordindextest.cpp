@@ -0,0 +1,270 @@
+/******************************************************************************
+  This source file is part of the Avogadro project.
+  This source code is released under the 3-Clause BSD License, (see "LICENSE").
+******************************************************************************/
+
+#include "recordindex.h"
+
+#include <QtCore/QBuffer>
+#include <QtCore/QFile>
+#include <QtCore/QTemporaryDir>
+#include <QtTest/QtTest>
+
+using Avogadro::RecordIndex;
+
+namespace {
+const QByteArray water = "3\n"
+                         "water\n"
+                         "O 0.000 0.000 0.117\n"
+                         "H 0.000 0.757 -0.467\n"
+                         "H 0.000 -0.757 -0.467\n";
+
+const QByteArray methane = "5\n"
+                           "\n"
+                           "C 0.000 0.000 0.000\n"
+                           "H 0.629 0.629 0.629\n"
+                           "H -0.629 -0.629 0.629\n"
+                           "H -0.629 0.629 -0.629\n"
+                           "H 0.629 -0.629 -0.629\n";
+
+QByteArray sdfRecord(const QByteArray& name)
+{
+  return name + "\n"
+                "  Avogadro\n"
+                "\n"
+                "  1  0  0  0  0  0  0  0  0  0999 V2000\n"
+                "    0.0000    0.0000    0.0000 C   0  0  0  0  0  0\n"
+                "M  END\n"
+                "> <NAME>\n" +
+         name + "\n\n$$$$\n";
+}
+
+QByteArray pdbModel(int number)
+{
+  return "MODEL     " + QByteArray::number(number).rightJustified(4) + "\n" +
+         "ATOM      1  O   HOH A   1       0.000   0.000   0.117  1.00  "
+         "0.00           O\n"
+         "ENDMDL\n";
+}
+
+/** Scan @a data, collecting the contents of the records. */
+bool scan(const QByteArray& data, RecordIndex::Layout layout,
+          QList<RecordIndex::Record>& records, QList<QByteArray>& contents)
+{
+  QByteArray copy = data;
+  QBuffer device(&copy);
+  device.open(QIODevice::ReadOnly);
+  return RecordIndex::scan(
+    device, layout,
+    [&](const RecordIndex::Record& record, const QByteArray& content) {
+      records << record;
+      contents << content;
+      return true;
+    });
+}
+} // namespace
+
+class RecordIndexTest : public QObject
+{
+  Q_OBJECT
+
+private slots:
+  void layoutForFile_data();
+  void layoutForFile();
+
+  void xyz();
+  void xyzTruncated();
+  void xyzNotACount();
+  void sdf();
+  void sdfWithoutTerminator();
+  void pdbModels();
+  void pdbWithoutModels();
+  void pdbUnterminatedModel();
+  void stopScan();
+  void buildAndRead();
+};
+
+void RecordIndexTest::layoutForFile_data()
+{
+  QTest::addColumn<QString>("fileName");
+  QTest::addColumn<int>("layout");
+
+  QTest::newRow("xyz") << "traj.xyz" << int(RecordIndex::Xyz);
+  QTest::newRow("upper case") << "TRAJ.XYZ" << int(RecordIndex::Xyz);
+  QTest::newRow("sdf") << "library.sdf" << int(RecordIndex::Sdf);
+  QTest::newRow("sd") << "library.sd" << int(RecordIndex::Sdf);
+  QTest::newRow("pdb") << "models.pdb" << int(RecordIndex::Pdb);
+  QTest::newRow("ent") << "pdb1crn.ent" << int(RecordIndex::Pdb);
+  QTest::newRow("cjson") << "water.cjson" << int(RecordIndex::Unknown);
+  QTest::newRow("compressed") << "traj.xyz.gz" << int(RecordIndex::Unknown);
+}
+
+void RecordIndexTest::layoutForFile()
+{
+  QFETCH(QString, fileName);
+  QFETCH(int, layout);
+  QCOMPARE(int(RecordIndex::layoutForFile(fileName)), layout);
+}
+
+void RecordIndexTest::xyz()
+{
+  // Blank lines between frames are skipped.
+  QByteArray data = water + "\n" + methane + water;
+  QList<RecordIndex::Record> records;
+  QList<QByteArray> contents;
+  QVERIFY(scan(data, RecordIndex::Xyz, records, contents));
+
+  QCOMPARE(records.size(), 3);
+  QCOMPARE(contents, QList<QByteArray>() << water << methane << water);
+  foreach (const RecordIndex::Record& record, records)
+    QCOMPARE(data.mid(record.offset, record.length), contents.takeFirst());
+  QCOMPARE(records.at(1).offset, qint64(water.size() + 1));
+}
+
+void RecordIndexTest::xyzTruncated()
+{
+  QByteArray data = water + methane.left(methane.size() - 30);
+  QList<RecordIndex::Record> records;
+  QList<QByteArray> contents;
+  QVERIFY(!scan(data, RecordIndex::Xyz, records, contents));
+  QCOMPARE(contents, QList<QByteArray>() << water);
+}
+
+void RecordIndexTest::xyzNotACount()
+{
+  QList<RecordIndex::Record> records;
+  QList<QByteArray> contents;
+  QVERIFY(!scan("water\n" + water, RecordIndex::Xyz, records, contents));
+  QVERIFY(records.isEmpty());
+}
+
+void RecordIndexTest::sdf()
+{
+  QByteArray data = sdfRecord("ethane") + sdfRecord("benzene") +
+                    sdfRecord("caffeine");
+  QList<RecordIndex::Record> records;
+  QList<QByteArray> contents;
+  QVERIFY(scan(data, RecordIndex::Sdf, records, contents));
+
+  QCOMPARE(contents, QList<QByteArray>() << sdfRecord("ethane")
+                                         << sdfRecord("benzene")
+                                         << sdfRecord("caffeine"));
+  QCOMPARE(records.at(0).offset, qint64(0));
+  QCOMPARE(records.at(2).offset,
+           qint64(data.size() - sdfRecord("caffeine").size()));
+  QCOMPARE(records.at(2).offset + records.at(2).length, qint64(data.size()));
+}
+
+void RecordIndexTest::sdfWithoutTerminator()
+{
+  QByteArray last = sdfRecord("benzene");
+  last.chop(5);
+  QByteArray data = sdfRecord("ethane") + last;
+  QList<RecordIndex::Record> records;
+  QList<QByteArray> contents;
+  QVERIFY(scan(data, RecordIndex::Sdf, records, contents));
+  QCOMPARE(contents, QList<QByteArray>() << sdfRecord("ethane") << last);
+
+  // Trailing blank lines are not a record.
+  records.clear();
+  contents.clear();
+  QVERIFY(scan(sdfRecord("ethane") + "\n\n", RecordIndex::Sdf, records,
+               contents));
+  QCOMPARE(records.size(), 1);
+}
+
+void RecordIndexTest::pdbModels()
+{
+  QByteArray header = "HEADER    WATER\n";
+  QByteArray data = header + pdbModel(1) + pdbModel(2) + "END\n";
+  QList<RecordIndex::Record> records;
+  QList<QByteArray> contents;
+  QVERIFY(scan(data, RecordIndex::Pdb, records, contents));
+
+  // The header is part of the first model only.
+  QCOMPARE(contents, QList<QByteArray>() << header + pdbModel(1)
+                                         << pdbModel(2));
+  QCOMPARE(records.at(1).offset, qint64(header.size() + pdbModel(1).size()));
+}
+
+void RecordIndexTest::pdbWithoutModels()
+{
+  QByteArray data = "HEADER    WATER\n"
+                    "ATOM      1  O   HOH A   1       0.000   0.000   0.117\n"
+                    "END\n";
+  QList<RecordIndex::Record> records;
+  QList<QByteArray> contents;
+  QVERIFY(scan(data, RecordIndex::Pdb, records, contents));
+  QCOMPARE(contents, QList<QByteArray>() << data);
+}
+
+void RecordIndexTest::pdbUnterminatedModel()
+{
+  QByteArray unterminated = pdbModel(2);
+  unterminated.chop(7);
+  QList<RecordIndex::Record> records;
+  QList<QByteArray> contents;
+  QVERIFY(!scan(pdbModel(1) + unterminated, RecordIndex::Pdb, records,
+                contents));
+  QCOMPARE(contents, QList<QByteArray>() << pdbModel(1));
+
+  // A MODEL inside another one.
+  records.clear();
+  contents.clear();
+  QVERIFY(!scan(unterminated + pdbModel(2), RecordIndex::Pdb, records,
+                contents));
+  QVERIFY(records.isEmpty());
+}
+
+void RecordIndexTest::stopScan()
+{
+  QByteArray data = water + water + water;
+  QBuffer device(&data);
+  device.open(QIODevice::ReadOnly);
+  int visited = 0;
+  QVERIFY(RecordIndex::scan(
+    device, RecordIndex::Xyz,
+    [&visited](const RecordIndex::Record&, const QByteArray&) {
+      return ++visited < 2;
+    }));
+  QCOMPARE(visited, 2);
+  QCOMPARE(device.pos(), qint64(2 * water.size()));
+}
+
+void RecordIndexTest::buildAndRead()
+{
+  QTemporaryDir dir;
+  QVERIFY(dir.isValid());
+  QString fileName = dir.filePath("library.sdf");
+  QFile file(fileName);
+  QVERIFY(file.open(QIODevice::WriteOnly));
+  file.write(sdfRecord("ethane") + sdfRecord("benzene"));
+  file.close();
+
+  RecordIndex index;
+  QVERIFY(index.build(fileName));
+  QCOMPARE(index.layout(), RecordIndex::Sdf);
+  QCOMPARE(index.fileName(), fileName);
+  QCOMPARE(index.size(), 2);
+
+  QVERIFY(file.open(QIODevice::ReadOnly));
+  QCOMPARE(index.read(file, 1), sdfRecord("benzene"));
+  QCOMPARE(index.read(file, 0), sdfRecord("ethane"));
+  QVERIFY(index.read(file, 2).isEmpty());
+  QVERIFY(index.read(file, -1).isEmpty());
+
+  // The layout can be given when the name does not tell.
+  QString renamed = dir.filePath("library.txt");
+  QVERIFY(QFile::copy(fileName, renamed));
+  QVERIFY(!index.build(renamed));
+  QVERIFY(index.build(renamed, RecordIndex::Sdf));
+  QCOMPARE(index.size(), 2);
+
+  QVERIFY(!index.build(dir.filePath("missing.sdf")));
+  QCOMPARE(index.size(), 0);
+  QVERIFY(!index.build(dir.filePath("water.cjson")));
+  QCOMPARE(index.layout(), RecordIndex::Unknown);
+}
+
+QTEST_GUILESS_MAIN(RecordIndexTest)
+#include "recordindextest.moc"